@@ -0,0 +1,129 @@
+#include <opencv2/core.hpp>
+#include <opencv2/ml.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/**
+ * Microbenchmark for the inference of classifier::classifyBatch().
+ * Loads the saved random forests and classifies random, normalized feature vectors with
+ *  - the old path: predict() and getVotes() on both forests, one object at a time
+ *  - the single evaluation path: only getVotes(), one object at a time
+ *  - the single evaluation path for all objects in one call
+ *
+ * Usage: classifier_benchmark <path/to/vision> [objects] [repetitions]
+ */
+
+const int COLOR_ATTRIBUTES_PER_SAMPLE = 24;
+const int CVFH_ATTRIBUTES_PER_SAMPLE = 308;
+
+cv::Ptr<cv::ml::RTrees> color_forest;
+cv::Ptr<cv::ml::RTrees> cvfh_forest;
+
+/**
+ * Random features, every row normalized like in classifier::classifyBatch().
+ */
+cv::Mat randomFeatures(int objects, int attributes) {
+    cv::Mat features(objects, attributes, CV_32FC1);
+    cv::randu(features, 0.0f, 1.0f);
+    for (int i = 0; i < objects; i++) {
+        cv::Mat row = features.row(i);
+        cv::normalize(row, row, 1, 0, cv::NORM_L1);
+    }
+    return features;
+}
+
+int highestVoteColumn(const cv::Mat &votes, int row) {
+    const int *values = votes.ptr<int>(row);
+    int highest_column = 0;
+    for (int x = 1; x < votes.cols; x++) {
+        if (values[x] > values[highest_column]) {
+            highest_column = x;
+        }
+    }
+    return highest_column;
+}
+
+/**
+ * The old way: every forest is evaluated twice per object.
+ * Returns a checksum, so the compiler can't drop the work.
+ */
+int classifyLegacy(const cv::Mat &color_row, const cv::Mat &cvfh_row) {
+    int color_prediction = (int) color_forest->predict(color_row);
+    int cvfh_prediction = (int) cvfh_forest->predict(cvfh_row);
+    cv::Mat color_votes, cvfh_votes, combined_votes;
+    color_forest->getVotes(color_row, color_votes, 0);
+    cvfh_forest->getVotes(cvfh_row, cvfh_votes, 0);
+    cv::add(color_votes, cvfh_votes, combined_votes);
+    return highestVoteColumn(combined_votes, 1) + color_prediction + cvfh_prediction;
+}
+
+/**
+ * Only the votes, the predictions are read from them.
+ */
+int classifySingleEvaluation(const cv::Mat &color_features, const cv::Mat &cvfh_features) {
+    cv::Mat color_votes, cvfh_votes, combined_votes;
+    color_forest->getVotes(color_features, color_votes, 0);
+    cvfh_forest->getVotes(cvfh_features, cvfh_votes, 0);
+    cv::add(color_votes, cvfh_votes, combined_votes);
+    int checksum = 0;
+    for (int i = 1; i < combined_votes.rows; i++) {
+        checksum += highestVoteColumn(color_votes, i) + highestVoteColumn(cvfh_votes, i)
+                    + highestVoteColumn(combined_votes, i);
+    }
+    return checksum;
+}
+
+void report(const std::string &name, int64 ticks, int objects, int repetitions) {
+    double us_per_object = (double) ticks / cv::getTickFrequency() * 1e6 / (objects * repetitions);
+    std::cout << name << ": " << us_per_object << " us/object" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <path/to/vision> [objects] [repetitions]" << std::endl;
+        return 1;
+    }
+    std::string pkg_path = argv[1];
+    int objects = argc > 2 ? std::atoi(argv[2]) : 100;
+    int repetitions = argc > 3 ? std::atoi(argv[3]) : 10;
+
+    color_forest = cv::ml::RTrees::load(pkg_path + "/random_trees_color_save");
+    cvfh_forest = cv::ml::RTrees::load(pkg_path + "/random_trees_cvfh_save");
+    if (color_forest.empty() || cvfh_forest.empty() || !color_forest->isTrained() || !cvfh_forest->isTrained()) {
+        std::cerr << "Couldn't load the forests from " << pkg_path << std::endl;
+        return 1;
+    }
+
+    cv::theRNG().state = 42;
+    cv::Mat color_features = randomFeatures(objects, COLOR_ATTRIBUTES_PER_SAMPLE);
+    cv::Mat cvfh_features = randomFeatures(objects, CVFH_ATTRIBUTES_PER_SAMPLE);
+    std::cout << objects << " objects, " << repetitions << " repetitions" << std::endl;
+
+    int checksum = 0;
+    int64 start = cv::getTickCount();
+    for (int r = 0; r < repetitions; r++) {
+        for (int i = 0; i < objects; i++) {
+            checksum += classifyLegacy(color_features.row(i), cvfh_features.row(i));
+        }
+    }
+    report("before: predict + getVotes, per object", cv::getTickCount() - start, objects, repetitions);
+
+    start = cv::getTickCount();
+    for (int r = 0; r < repetitions; r++) {
+        for (int i = 0; i < objects; i++) {
+            checksum += classifySingleEvaluation(color_features.row(i), cvfh_features.row(i));
+        }
+    }
+    report("after: getVotes only, per object", cv::getTickCount() - start, objects, repetitions);
+
+    start = cv::getTickCount();
+    for (int r = 0; r < repetitions; r++) {
+        checksum += classifySingleEvaluation(color_features, cvfh_features);
+    }
+    report("after: getVotes only, batched", cv::getTickCount() - start, objects, repetitions);
+
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+    return 0;
+}
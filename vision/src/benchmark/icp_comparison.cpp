@@ -0,0 +1,217 @@
+#include "../perception/perception.h"
+
+#include <pcl/common/time.h>
+#include <pcl/common/transforms.h>
+#include <pcl/console/print.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/variate_generator.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Compares the pose of the pyramid ICP with the one of the full resolution ICP, which findPose used before.
+ * Every mesh of the model registry is moved by known offsets and downsampled and disturbed like a perceived
+ * object, then aligned with every method. Prints one CSV line per mesh, offset and method:
+ *
+ *   mesh,angle_deg,method,converged,ms,fitness,rotation_error_deg,translation_error_mm
+ *
+ * fitness is the mean squared distance (m^2) from the perceived points to the aligned mesh, the errors compare
+ * the transformation of the method with the known offset. The means of every method are printed at the end.
+ * The perceived objects are whole meshes, so rotation errors of rotationally symmetric objects are only
+ * meaningful together with their fitness.
+ *
+ * Usage: rosrun vision_suturo icp_comparison <path/to/vision> [angles]
+ *        angles are comma separated degrees, e.g. 5,15,30
+ */
+
+const float PERCEIVED_LEAF_SIZE = 0.005f; // like the voxel grid of the pipeline
+const float NOISE_SIGMA = 0.002f;         // meters, kinect noise at about 1 m
+
+enum Method {
+    METHOD_FULL,
+    METHOD_PYRAMID,
+    METHOD_PYRAMID_POINT_TO_PLANE,
+    METHOD_PYRAMID_GLOBAL,
+    METHOD_COUNT
+};
+
+const char *METHOD_NAMES[METHOD_COUNT] = {"full", "pyramid", "pyramid_point_to_plane", "pyramid_global"};
+
+// One label per mesh of the model registry
+const char *MESH_LABELS[] = {"CupEcoOrange", "EdekaRedBowl", "HelaCurryKetchup", "JaMilch", "KelloggsToppasMini",
+                             "KoellnMuesliKnusperHonigNuss", "PringlesSalt", "SiggBottle", "TomatoSauceOroDiParma"};
+
+/**
+ * Sums of the results of one method.
+ */
+struct MethodTotals {
+    int runs;
+    int converged;
+    double ms;
+    double fitness;
+    double rotation_error_deg;
+    double translation_error_mm;
+
+    MethodTotals() : runs(0), converged(0), ms(0.0), fitness(0.0), rotation_error_deg(0.0),
+                     translation_error_mm(0.0) {}
+};
+
+boost::mt19937 random_generator(42); // the same disturbed clouds every run
+
+/**
+ * @param offset known transformation of the mesh
+ * @param model mesh with normals
+ * @return The mesh moved by offset, downsampled, with noise on the points
+ */
+PointCloudRGBNormalPtr perceivedObject(const Eigen::Matrix4f &offset, const ObjectModel &model) {
+    PointCloudRGBNormalPtr moved(new PointCloudRGBNormal);
+    pcl::transformPointCloudWithNormals(*model.cloud, *moved, offset);
+    PointCloudRGBNormalPtr perceived = voxelGridFilterWithNormals(moved, PERCEIVED_LEAF_SIZE);
+
+    boost::variate_generator<boost::mt19937 &, boost::normal_distribution<float> >
+            noise(random_generator, boost::normal_distribution<float>(0.0f, NOISE_SIGMA));
+    for (size_t i = 0; i < perceived->points.size(); i++) {
+        perceived->points[i].x += noise();
+        perceived->points[i].y += noise();
+        perceived->points[i].z += noise();
+    }
+    return perceived;
+}
+
+/**
+ * @return Mean squared distance from every perceived point to the closest point of the aligned mesh
+ */
+double fitnessOf(const PointCloudRGBNormalPtr &perceived, const PointCloudRGBPtr &aligned) {
+    pcl::search::KdTree<pcl::PointXYZRGB> tree;
+    tree.setInputCloud(aligned);
+    pcl::PointXYZRGB point;
+    std::vector<int> index(1);
+    std::vector<float> squared_distance(1);
+    double sum = 0.0;
+    for (size_t i = 0; i < perceived->points.size(); i++) {
+        pcl::copyPoint(perceived->points[i], point);
+        tree.nearestKSearch(point, 1, index, squared_distance);
+        sum += squared_distance[0];
+    }
+    return sum / perceived->points.size();
+}
+
+/**
+ * @return Angle in degrees of the rotation between the two transformations
+ */
+double rotationErrorOf(const Eigen::Matrix4f &estimated, const Eigen::Matrix4f &truth) {
+    Eigen::Matrix3f difference = estimated.block<3, 3>(0, 0) * truth.block<3, 3>(0, 0).transpose();
+    double cosine = (difference.trace() - 1.0) / 2.0;
+    return std::acos(std::max(-1.0, std::min(1.0, cosine))) * 180.0 / M_PI;
+}
+
+/**
+ * Aligns the mesh to a perceived object like estimatePose() does with the method.
+ * @param transformation returns the transformation from the mesh to the perceived object
+ * @return The aligned mesh, empty if the alignment failed
+ */
+PointCloudRGBPtr align(Method method, const PointCloudRGBNormalPtr &perceived, const ObjectModel &model,
+                       Eigen::Matrix4f &transformation) {
+    if (method == METHOD_FULL) {
+        PointCloudRGBPtr mesh(new PointCloudRGB), perceived_points(new PointCloudRGB);
+        pcl::copyPointCloud(*model.cloud, *mesh);
+        pcl::copyPointCloud(*perceived, *perceived_points);
+        return iterativeClosestPoint(mesh, perceived_points, transformation);
+    }
+    return pyramidIterativeClosestPoint(perceived, model, perception_params.icp_levels,
+                                        method == METHOD_PYRAMID_POINT_TO_PLANE,
+                                        method == METHOD_PYRAMID_GLOBAL, transformation);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <path/to/vision> [angles]\n", argv[0]);
+        return 1;
+    }
+    std::string pkg_path = argv[1];
+    std::string angles_argument = argc > 2 ? argv[2] : "5,15,30";
+    std::vector<float> angles;
+    std::stringstream angles_stream(angles_argument);
+    std::string angle;
+    while (std::getline(angles_stream, angle, ',')) {
+        angles.push_back(std::atof(angle.c_str()));
+    }
+
+    // Only warnings and errors, they go to stderr
+    ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn);
+    ros::console::notifyLoggerLevelsChanged();
+    pcl::console::setVerbosityLevel(pcl::console::L_WARN);
+
+    ModelRegistryConfig config = perception_params.modelRegistryConfig();
+    config.compute_features = true; // for pyramid_global
+    ModelRegistry registry;
+    registry.load(pkg_path + "/meshes/", config);
+
+    // Every mesh is turned around these axes and moved by 2 cm
+    std::vector<Eigen::Vector3f> axes;
+    axes.push_back(Eigen::Vector3f::UnitX());
+    axes.push_back(Eigen::Vector3f::UnitY());
+    axes.push_back(Eigen::Vector3f::UnitZ());
+    axes.push_back(Eigen::Vector3f(1.0f, 1.0f, 1.0f).normalized());
+
+    MethodTotals totals[METHOD_COUNT];
+    printf("mesh,angle_deg,method,converged,ms,fitness,rotation_error_deg,translation_error_mm\n");
+    for (size_t m = 0; m < sizeof(MESH_LABELS) / sizeof(MESH_LABELS[0]); m++) {
+        const ObjectModel *model = registry.get(MESH_LABELS[m]);
+        if (model == NULL) {
+            continue;
+        }
+        for (size_t a = 0; a < angles.size(); a++) {
+            for (size_t x = 0; x < axes.size(); x++) {
+                Eigen::Affine3f offset = Eigen::Affine3f::Identity();
+                offset.translate(Eigen::Vector3f(0.02f, 0.0f, 0.0f));
+                offset.rotate(Eigen::AngleAxisf(angles[a] * M_PI / 180.0f, axes[x]));
+                PointCloudRGBNormalPtr perceived = perceivedObject(offset.matrix(), *model);
+
+                for (int method = 0; method < METHOD_COUNT; method++) {
+                    Eigen::Matrix4f transformation = Eigen::Matrix4f::Identity();
+                    pcl::StopWatch watch;
+                    PointCloudRGBPtr aligned = align((Method) method, perceived, *model, transformation);
+                    double ms = watch.getTime();
+
+                    MethodTotals &total = totals[method];
+                    total.runs++;
+                    total.ms += ms;
+                    if (aligned->points.empty()) {
+                        printf("%s,%.1f,%s,0,%.1f,,,\n", model->file.c_str(), angles[a], METHOD_NAMES[method], ms);
+                        continue;
+                    }
+                    double fitness = fitnessOf(perceived, aligned);
+                    double rotation_error = rotationErrorOf(transformation, offset.matrix());
+                    double translation_error = (transformation.block<3, 1>(0, 3) -
+                                                offset.matrix().block<3, 1>(0, 3)).norm() * 1000.0;
+                    total.converged++;
+                    total.fitness += fitness;
+                    total.rotation_error_deg += rotation_error;
+                    total.translation_error_mm += translation_error;
+                    printf("%s,%.1f,%s,1,%.1f,%.8f,%.2f,%.2f\n", model->file.c_str(), angles[a],
+                           METHOD_NAMES[method], ms, fitness, rotation_error, translation_error);
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    fprintf(stderr, "method                  converged  mean ms  mean fitness  mean rotation error  mean translation error\n");
+    for (int method = 0; method < METHOD_COUNT; method++) {
+        const MethodTotals &total = totals[method];
+        int converged = std::max(total.converged, 1);
+        fprintf(stderr, "%-22s  %4d/%-4d  %7.1f  %12.8f  %15.2f deg  %17.2f mm\n", METHOD_NAMES[method],
+                total.converged, total.runs, total.runs > 0 ? total.ms / total.runs : 0.0,
+                total.fitness / converged, total.rotation_error_deg / converged,
+                total.translation_error_mm / converged);
+    }
+    return 0;
+}
@@ -0,0 +1,253 @@
+#include "../perception/perception.h"
+#include "../recognition/classifier.h"
+
+#include <pcl/common/time.h>
+#include <pcl/common/transforms.h>
+#include <pcl/console/print.h>
+#include <pcl/filters/filter.h>
+#include <pcl/io/pcd_io.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+/**
+ * Microbenchmarks of the single stages of the perception. Runs every stage on the meshes of the package
+ * and on recorded scenes, each downsampled to several sizes, and prints one CSV line per stage and cloud:
+ *
+ *   stage,input,points,repetitions,mean_ms,min_ms,points_per_s,allocations,allocated_bytes
+ *
+ * allocations and allocated_bytes are per call and count operator new, clouds allocated by Eigen
+ * directly aren't included. The log of the stages goes to stderr, so the output can be saved and
+ * compared between commits.
+ *
+ * Usage: rosrun vision_suturo perception_benchmark <path/to/vision> [repetitions] [sizes] [scene.pcd ...]
+ *        sizes are comma separated point counts, e.g. 1000,10000,50000
+ */
+
+#if __cplusplus >= 201103L
+#define NEW_THROWS
+#define DELETE_THROWS noexcept
+#else
+#define NEW_THROWS throw(std::bad_alloc)
+#define DELETE_THROWS throw()
+#endif
+
+static size_t allocation_count = 0;
+static size_t allocation_bytes = 0;
+
+void *operator new(size_t size) NEW_THROWS {
+    __sync_fetch_and_add(&allocation_count, 1);
+    __sync_fetch_and_add(&allocation_bytes, size);
+    void *memory = std::malloc(size > 0 ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) DELETE_THROWS {
+    std::free(memory);
+}
+
+/**
+ * Time and allocations of one stage, averaged over the repetitions.
+ */
+struct Measurement {
+    double mean_ms;
+    double min_ms;
+    double allocations;
+    double allocated_bytes;
+};
+
+classifier benchmark_classifier;
+PerceptionCoreParams core_params; // what the vision node uses
+
+/**
+ * Runs a stage once without measuring, then repetitions times.
+ */
+Measurement measure(const boost::function<void()> &stage, int repetitions) {
+    stage();
+
+    Measurement measurement;
+    measurement.min_ms = 0.0;
+    double total_ms = 0.0;
+    size_t count_before = allocation_count;
+    size_t bytes_before = allocation_bytes;
+    for (int r = 0; r < repetitions; r++) {
+        pcl::StopWatch watch;
+        stage();
+        double ms = watch.getTime();
+        total_ms += ms;
+        if (r == 0 || ms < measurement.min_ms) {
+            measurement.min_ms = ms;
+        }
+    }
+    measurement.mean_ms = total_ms / repetitions;
+    measurement.allocations = (double) (allocation_count - count_before) / repetitions;
+    measurement.allocated_bytes = (double) (allocation_bytes - bytes_before) / repetitions;
+    return measurement;
+}
+
+void report(const std::string &stage, const std::string &input, size_t points, int repetitions,
+            const Measurement &measurement) {
+    double points_per_s = measurement.mean_ms > 0.0 ? points / (measurement.mean_ms / 1000.0) : 0.0;
+    printf("%s,%s,%lu,%d,%.3f,%.3f,%.0f,%.0f,%.0f\n", stage.c_str(), input.c_str(), points, repetitions,
+           measurement.mean_ms, measurement.min_ms, points_per_s, measurement.allocations,
+           measurement.allocated_bytes);
+    fflush(stdout);
+}
+
+// Every call gets a new search cache and no plane hints, so no call reuses the work of the one before
+
+void runEuclideanClusterExtraction(PointCloudRGBNormalPtr input) {
+    SearchCache search_cache;
+    euclideanClusterExtraction(input, search_cache, core_params);
+}
+
+void runSegmentPlanes(PointCloudRGBNormalPtr input) {
+    std::vector<Eigen::VectorXf> plane_hints;
+    segmentPlanes(input, plane_hints);
+}
+
+void runCvfhRecognition(PointCloudRGBNormalPtr input) {
+    SearchCache search_cache;
+    cvfhRecognition(input, search_cache, core_params);
+}
+
+void runIterativeClosestPoint(PointCloudRGBPtr input, PointCloudRGBPtr target) {
+    Eigen::Matrix4f transformation;
+    iterativeClosestPoint(input, target, transformation);
+}
+
+void runClassify(const std::vector<uint64_t> &color_features, const std::vector<float> &cvfh_features) {
+    benchmark_classifier.classify(color_features, cvfh_features);
+}
+
+/**
+ * Keeps every n-th point, so the cloud has at most size points.
+ */
+PointCloudRGBPtr downsample(const PointCloudRGBPtr &input, size_t size) {
+    if (input->size() <= size) {
+        return input;
+    }
+    PointCloudRGBPtr output(new PointCloudRGB);
+    double step = (double) input->size() / size;
+    for (size_t i = 0; i < size; i++) {
+        output->push_back(input->points[(size_t) (i * step)]);
+    }
+    return output;
+}
+
+/**
+ * Runs all stages on one cloud.
+ */
+void benchmarkCloud(const std::string &input, const PointCloudRGBPtr &cloud, int repetitions) {
+    size_t points = cloud->size();
+
+    report("apply3DFilter", input, points, repetitions,
+           measure(boost::bind(&apply3DFilter, cloud, 0.4f, 0.4f, 1.5f, false, PointCloudRGBPtr()), repetitions));
+    report("voxelGridFilter", input, points, repetitions,
+           measure(boost::bind(&voxelGridFilter, cloud, core_params.voxel_leaf_size), repetitions));
+    report("mlsFilter", input, points, repetitions,
+           measure(boost::bind(&mlsFilter, cloud, boost::cref(core_params)), repetitions));
+
+    // The following stages work on the clouds with normals
+    PointCloudRGBNormalPtr normals = mlsFilter(cloud, core_params);
+    if (normals->empty()) {
+        fprintf(stderr, "%s: no points left after mlsFilter, skipping the other stages\n", input.c_str());
+        return;
+    }
+    report("euclideanClusterExtraction", input, normals->size(), repetitions,
+           measure(boost::bind(&runEuclideanClusterExtraction, normals), repetitions));
+    report("segmentPlanes", input, normals->size(), repetitions,
+           measure(boost::bind(&runSegmentPlanes, normals), repetitions));
+    report("cvfhRecognition", input, normals->size(), repetitions,
+           measure(boost::bind(&runCvfhRecognition, normals), repetitions));
+    report("produceColorHist", input, normals->size(), repetitions,
+           measure(boost::bind(&produceColorHist, normals, boost::cref(core_params)), repetitions));
+
+    // Aligns the cloud with a copy of itself, moved by 1 cm and turned by 5 degrees
+    PointCloudRGBPtr target(new PointCloudRGB);
+    Eigen::Affine3f offset = Eigen::Affine3f::Identity();
+    offset.translate(Eigen::Vector3f(0.01f, 0.0f, 0.0f));
+    offset.rotate(Eigen::AngleAxisf(5.0f * M_PI / 180.0f, Eigen::Vector3f::UnitZ()));
+    pcl::transformPointCloud(*cloud, *target, offset);
+    report("iterativeClosestPoint", input, points, repetitions,
+           measure(boost::bind(&runIterativeClosestPoint, cloud, target), repetitions));
+
+    SearchCache search_cache;
+    std::vector<uint64_t> color_features = produceColorHist(normals, core_params);
+    PointCloudVFHS308Ptr cvfh = cvfhRecognition(normals, search_cache, core_params);
+    std::vector<float> cvfh_features;
+    if (!cvfh->empty()) {
+        cvfh_features.assign(cvfh->points[0].histogram, cvfh->points[0].histogram + CVFH_FEATURES_PER_OBJECT);
+    }
+    report("classifier::classify", input, normals->size(), repetitions,
+           measure(boost::bind(&runClassify, boost::cref(color_features), boost::cref(cvfh_features)), repetitions));
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <path/to/vision> [repetitions] [sizes] [scene.pcd ...]\n", argv[0]);
+        return 1;
+    }
+    std::string pkg_path = argv[1];
+    int repetitions = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 10;
+    std::string sizes_argument = argc > 3 ? argv[3] : "1000,10000,50000";
+    std::vector<std::string> size_names;
+    boost::split(size_names, sizes_argument, boost::is_any_of(","));
+    std::vector<size_t> sizes;
+    for (size_t i = 0; i < size_names.size(); i++) {
+        int size = std::atoi(size_names[i].c_str());
+        if (size > 0) {
+            sizes.push_back(size);
+        }
+    }
+
+    // Only warnings and errors, they go to stderr
+    ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn);
+    ros::console::notifyLoggerLevelsChanged();
+    pcl::console::setVerbosityLevel(pcl::console::L_WARN);
+
+    std::vector<std::string> files;
+    for (boost::filesystem::directory_iterator it(pkg_path + "/meshes"), end; it != end; ++it) {
+        if (it->path().extension() == ".pcd") {
+            files.push_back(it->path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    for (int i = 4; i < argc; i++) {
+        files.push_back(argv[i]);
+    }
+
+    benchmark_classifier.train("", false);
+
+    printf("stage,input,points,repetitions,mean_ms,min_ms,points_per_s,allocations,allocated_bytes\n");
+    for (size_t f = 0; f < files.size(); f++) {
+        PointCloudRGBPtr cloud(new PointCloudRGB);
+        if (pcl::io::loadPCDFile(files[f], *cloud) < 0 || cloud->empty()) {
+            fprintf(stderr, "Couldn't load %s\n", files[f].c_str());
+            continue;
+        }
+        std::vector<int> finite;
+        pcl::removeNaNFromPointCloud(*cloud, *cloud, finite);
+        std::string name = boost::filesystem::path(files[f]).stem().string();
+
+        // Every size smaller than the cloud, and the whole cloud once
+        for (size_t s = 0; s < sizes.size(); s++) {
+            if (sizes[s] < cloud->size()) {
+                benchmarkCloud(name, downsample(cloud, sizes[s]), repetitions);
+            }
+        }
+        benchmarkCloud(name, cloud, repetitions);
+    }
+    return 0;
+}
@@ -11,41 +11,131 @@ const char *PCD_KINECT_POINTS_FRAME = "/cloud_pcd";
 
 PointCloudRGBPtr scene(new PointCloudRGB);
 
+// Latest message of the kinect. It is only converted into scene when a service needs it.
+sensor_msgs::PointCloud2ConstPtr kinect_msg;
+sensor_msgs::PointCloud2ConstPtr scene_msg; // message scene has been converted from
+boost::mutex kinect_msg_mutex;
+boost::condition_variable kinect_msg_condition; // notified for every new message
+
+// Continuous mode: the perception runs in the background and the services return its latest result
+bool continuous_mode = false;
+double max_result_age = 1.0; // seconds, older results are computed again
+boost::shared_ptr<const PerceptionResult> latest_result;
+boost::mutex latest_result_mutex;
+boost::mutex pipeline_mutex; // only one perception run at a time
+std::vector<Eigen::VectorXf> plane_hints; // planes of the last frame, guarded by pipeline_mutex
+PointCloudRGBPtr cropped_buffer(new PointCloudRGB); // reused by the crop filter, guarded by pipeline_mutex
+
 
 // ros::NodeHandle n_global;
 
 geometry_msgs::PointStamped centroid_stamped;
 
-std::vector<PointCloudRGBPtr> all_clusters;
+std::vector<PointCloudRGBNormalPtr> all_clusters;
+std::vector<std::string> all_labels; // classifier results of all_clusters
+boost::mutex all_clusters_mutex;     // guards all_clusters and all_labels
 
 classifier my_classifier;
 
-ros::Publisher pub_visualization;
+// Runs the per-object work of the services in parallel
+boost::shared_ptr<WorkerPool> worker_pool;
+
+// Lives as long as the node, so its tf buffer is filled when a service needs it
+boost::shared_ptr<CloudTransformer> cloud_transformer;
+
+// Topics of the debugging clouds
+DebugTopic topic_visualization_object;
+DebugTopic topic_perceived_object;
+DebugTopic topic_mesh_object;
+DebugTopic topic_aligned_object;
+ros::Publisher pub_pose;
+double debug_voxel_size = 0.0; // debugging clouds are downsampled to this voxel size, 0 publishes all points
+
+// Flight recorder: failed runs dump the recent frames, but not more often than every dump_interval seconds
+bool dump_on_failure = false;
+double dump_interval = 30.0;
 
 
 
 
-// Use a callback function for the kinect subscriber to pass the NodeHandle to use in perception.h
 /**
- * Callback-function saves the PointCloud received through the kinect
- * @param kinect PointCloud
+ * Callback-function keeps the latest message received through the kinect and hands it to the flight recorder.
+ * Converting it is left to updateScene(), so frames nobody asks for cost nothing.
+ * @param kinect PointCloud message
  */
-void sub_kinect_callback(sensor_msgs::PointCloud2 kinect) {
-    pcl::fromROSMsg(kinect, *scene);
-    cloud_perceived = scene;
-    if (scene->size() == 0) {
-        ROS_ERROR("Kinect has no image");
-        error_message += "No image from kinect. ";
+void sub_kinect_callback(const sensor_msgs::PointCloud2ConstPtr &kinect) {
+    if (flight_recorder) {
+        flight_recorder->recordFrame(kinect);
     }
+    boost::mutex::scoped_lock lock(kinect_msg_mutex);
+    kinect_msg = kinect;
+    kinect_msg_condition.notify_all();
+}
 
+/**
+ * Converts the latest kinect message into scene, unless scene already holds it.
+ * A new PointCloud is created for every message, so results that still use the old scene stay valid.
+ * @return false if no message has been received yet
+ */
+bool updateScene() {
+    sensor_msgs::PointCloud2ConstPtr msg;
+    {
+        boost::mutex::scoped_lock lock(kinect_msg_mutex);
+        msg = kinect_msg;
+    }
+    if (!msg) {
+        return false;
+    }
+    if (msg != scene_msg) {
+        PointCloudRGBPtr cloud(new PointCloudRGB);
+        pcl::fromROSMsg(*msg, *cloud);
+        scene = cloud;
+        scene_msg = msg;
+        boost::mutex::scoped_lock lock(debug_clouds_mutex);
+        cloud_perceived = scene;
+    }
+    return true;
+}
+
+/**
+ * Broadcasts the pose of the last object whose pose has been estimated.
+ * @param pose of the object
+ */
+void broadcastObjectPose(const geometry_msgs::PoseStamped &pose) {
     static tf::TransformBroadcaster br;
     tf::Transform transform;
-    transform.setOrigin(tf::Vector3(pose_global.pose.position.x, pose_global.pose.position.y, 0.0));
+    transform.setOrigin(tf::Vector3(pose.pose.position.x, pose.pose.position.y, 0.0));
     tf::Quaternion q;
-    q.setRPY(0, 0, pose_global.pose.orientation.z);
+    q.setRPY(0, 0, pose.pose.orientation.z);
     transform.setRotation(q);
     br.sendTransform(tf::StampedTransform(transform, ros::Time::now(), "base_link", "object/pose"));
+}
 
+/**
+ * Creates the snapshot writer, which saves the clouds of the pipeline stages to the data folder of the package.
+ * @param format "binary" or "binary_compressed"
+ * @param stages comma separated names of the stages to save, e.g. "kinect,final". Empty saves nothing.
+ * @param queue_size clouds that may wait for the disk
+ */
+void startSnapshotWriter(const std::string &format, const std::string &stages, int queue_size) {
+    std::vector<std::string> stage_names;
+    boost::split(stage_names, stages, boost::is_any_of(", "), boost::token_compress_on);
+
+    snapshot_writer.reset(new SnapshotWriter(ros::package::getPath("vision_suturo") + "/data/",
+                                             format == "binary" ? SNAPSHOT_BINARY : SNAPSHOT_BINARY_COMPRESSED,
+                                             std::max(queue_size, 1)));
+    for (int i = 0; i < SNAPSHOT_STAGE_COUNT; i++) {
+        snapshot_writer->setStageEnabled(static_cast<SnapshotStage>(i), false);
+    }
+    for (size_t i = 0; i < stage_names.size(); i++) {
+        SnapshotStage stage;
+        if (SnapshotWriter::parseStage(stage_names[i], stage)) {
+            snapshot_writer->setStageEnabled(stage, true);
+        } else if (!stage_names[i].empty()) {
+            ROS_WARN("Suturo-Vision: unknown snapshot stage %s", stage_names[i].c_str());
+        }
+    }
+    ROS_INFO("Suturo-Vision: saving snapshots of \"%s\" as %s", stages.c_str(), format.c_str());
 }
 
 /**
@@ -58,132 +148,402 @@ void start_node(int argc, char **argv) {
 
     /** nodehandle, subscribers and publishers**/
     ros::NodeHandle n;
-
-    // Subscriber for the kinect points. Also calls findCluster.
-    ros::Subscriber sub_kinect = n.subscribe(REAL_KINECT_POINTS_FRAME, 10, &sub_kinect_callback);
-    ros::Subscriber sub = n.subscribe("object/pose", 10, &sub_kinect_callback);
+    ros::NodeHandle n_private("~");
+
+    /** parameters **/
+    n_private.param("organized_mode", perception_params.organized_mode, false);
+    // Only with forests trained by the batch_processor with --mls-normals
+    n_private.param("cvfh_mls_normals", perception_params.core.cvfh_mls_normals, false);
+    // Radius of the estimated normals, the shipped forests were trained with 0.03
+    n_private.param("normal_radius", perception_params.core.normal_radius, 0.03f);
+    ROS_INFO("Suturo-Vision: organized mode %s", perception_params.organized_mode ? "enabled" : "disabled");
+    n_private.param("pyramid_icp", perception_params.pyramid_icp, false);
+    n_private.param("icp_point_to_plane", perception_params.icp_point_to_plane, false);
+    n_private.param("global_alignment", perception_params.global_alignment, false);
+    ROS_INFO("Suturo-Vision: %s ICP%s%s", perception_params.pyramid_icp ? "pyramid" : "full resolution",
+             perception_params.pyramid_icp && perception_params.icp_point_to_plane ? " (point to plane)" : "",
+             perception_params.pyramid_icp && perception_params.global_alignment ? " with global alignment" : "");
+    int worker_threads;
+    n_private.param("worker_threads", worker_threads, 0); // 0 = one per core
+    worker_pool.reset(new WorkerPool(std::max(worker_threads, 0)));
+    ROS_INFO("Suturo-Vision: %u worker threads", worker_pool->size());
+
+    n_private.param("debug_voxel_size", debug_voxel_size, 0.0);
+
+    // Snapshots of the pipeline stages are written in the background
+    std::string snapshot_format, snapshot_stages;
+    int snapshot_queue_size;
+    n_private.param<std::string>("snapshot_format", snapshot_format, "binary_compressed");
+    n_private.param<std::string>("snapshot_stages", snapshot_stages, "");
+    // A frame queues up to 4 stages and one cloud per object, so 64 clouds hold 4 frames of 12 objects
+    n_private.param("snapshot_queue_size", snapshot_queue_size, 64);
+    startSnapshotWriter(snapshot_format, snapshot_stages, snapshot_queue_size);
+
+    // The recent frames are kept in memory and only saved when asked for
+    int flight_recorder_frames, flight_recorder_max_mb;
+    n_private.param("flight_recorder_frames", flight_recorder_frames, 10); // 0 disables the flight recorder
+    n_private.param("flight_recorder_max_mb", flight_recorder_max_mb, 512);
+    n_private.param("dump_on_failure", dump_on_failure, false);
+    n_private.param("dump_interval", dump_interval, 30.0);
+    if (flight_recorder_frames > 0) {
+        flight_recorder.reset(new FlightRecorder(ros::package::getPath("vision_suturo") + "/data/",
+                                                 flight_recorder_frames,
+                                                 std::max(flight_recorder_max_mb, 1) * 1024ul * 1024ul));
+        ROS_INFO("Suturo-Vision: flight recorder keeps %d frames (at most %d MB)%s", flight_recorder_frames,
+                 flight_recorder_max_mb, dump_on_failure ? ", dumped on failures" : "");
+    }
+    n_private.param("continuous_mode", continuous_mode, false);
+    n_private.param("max_result_age", max_result_age, 1.0);
+    ROS_INFO("Suturo-Vision: continuous mode %s", continuous_mode ? "enabled" : "disabled");
+
+    cloud_transformer.reset(new CloudTransformer(n));
+
+    // Load and prepare all meshes, so getPoses doesn't have to
+    model_registry.load(ros::package::getPath("vision_suturo") + "/meshes/", perception_params.modelRegistryConfig());
+    ROS_INFO("Suturo-Vision: %lu object models loaded", model_registry.size());
+
+    // Every kind of callback has its own queue and thread, so a long getObjects blocks neither
+    // the kinect, the other services nor the visualization
+    ros::CallbackQueue sensor_queue, objects_queue, latest_objects_queue, poses_queue, all_poses_queue,
+            visualization_queue, dump_queue;
+    ros::NodeHandle n_sensor(n), n_objects(n), n_latest_objects(n), n_poses(n), n_all_poses(n), n_visualization(n),
+            n_dump(n);
+    n_sensor.setCallbackQueue(&sensor_queue);
+    n_objects.setCallbackQueue(&objects_queue);
+    n_latest_objects.setCallbackQueue(&latest_objects_queue);
+    n_poses.setCallbackQueue(&poses_queue);
+    n_all_poses.setCallbackQueue(&all_poses_queue);
+    n_visualization.setCallbackQueue(&visualization_queue);
+    n_dump.setCallbackQueue(&dump_queue);
+
+    // Subscriber for the kinect points. Only the latest frame is of interest.
+    // ~cloud_topic can point it to replayed frames, e.g. PCD_KINECT_POINTS_FRAME
+    std::string cloud_topic;
+    n_private.param<std::string>("cloud_topic", cloud_topic, REAL_KINECT_POINTS_FRAME);
+    ros::Subscriber sub_kinect = n_sensor.subscribe(cloud_topic, 1, &sub_kinect_callback);
+    ROS_INFO("Suturo-Vision: kinect points from %s", cloud_topic.c_str());
 
     /** services and clients **/
-    ros::ServiceServer object_service = n.advertiseService("vision_suturo/objects_information", getObjects);
-    ros::ServiceServer pose_service = n.advertiseService("vision_suturo/objects_poses", getPoses);
+    ros::ServiceServer object_service = n_objects.advertiseService("vision_suturo/objects_information", getObjects);
+    ros::ServiceServer pose_service = n_poses.advertiseService("vision_suturo/objects_poses", getPoses);
+    ros::ServiceServer all_poses_service = n_all_poses.advertiseService("vision_suturo/all_objects_poses",
+                                                                        getAllPoses);
+    ros::ServiceServer latest_objects_service = n_latest_objects.advertiseService("vision_suturo/latest_objects",
+                                                                                  getLatestObjects);
+    ros::ServiceServer dump_service = n_dump.advertiseService("vision_suturo/dump_flight_recorder",
+                                                              dumpFlightRecorder);
     ROS_INFO("%sSuturo-Vision: Services ready\n", "\x1B[32m");
 
-    // Visualization Publisher for debugging purposes
-    ros::Publisher pub_visualization_object = n.advertise<sensor_msgs::PointCloud2>("vision_suturo/visualization_cloud",
-                                                                                    0);
+    // Visualization Publisher for debugging purposes. Their connect callbacks run on the visualization queue,
+    // like the timer publishing the clouds, so they don't need a lock.
+    topic_visualization_object.publisher = n_visualization.advertise<sensor_msgs::PointCloud2>(
+            "vision_suturo/visualization_cloud", 0,
+            boost::bind(&debugSubscriberConnected, &topic_visualization_object, _1));
+    topic_perceived_object.publisher = n_visualization.advertise<sensor_msgs::PointCloud2>(
+            "vision_suturo/perceived_object", 0, boost::bind(&debugSubscriberConnected, &topic_perceived_object, _1));
+    topic_mesh_object.publisher = n_visualization.advertise<sensor_msgs::PointCloud2>(
+            "vision_suturo/mesh_object", 0, boost::bind(&debugSubscriberConnected, &topic_mesh_object, _1));
+    topic_aligned_object.publisher = n_visualization.advertise<sensor_msgs::PointCloud2>(
+            "vision_suturo/aligned_object", 0, boost::bind(&debugSubscriberConnected, &topic_aligned_object, _1));
+    pub_pose = n.advertise<geometry_msgs::PoseStamped>("vision_suturo/pose", 0);
+    ros::Timer visualization_timer = n_visualization.createTimer(ros::Duration(0.5), &publishVisualization);
 
+    std::string train_directory = "../../common_suturo1718/pcd_files";
+    my_classifier.train(train_directory, false);
 
-    ros::Publisher pub_perceived_object = n.advertise<sensor_msgs::PointCloud2>("vision_suturo/perceived_object", 0);
-    ros::Publisher pub_mesh_object = n.advertise<sensor_msgs::PointCloud2>("vision_suturo/mesh_object", 0);
+    ROS_INFO("%sVision is ready!\n", "\x1B[32m");
 
-    ros::Publisher pub_aligned_object = n.advertise<sensor_msgs::PointCloud2>("vision_suturo/aligned_object", 0);
+    boost::thread continuous_thread;
+    if (continuous_mode) {
+        continuous_thread = boost::thread(&continuousPerception);
+    }
 
-    ros::Publisher pub_pose = n.advertise<geometry_msgs::PoseStamped>("vision_suturo/pose", 0);
-    
+    ros::AsyncSpinner sensor_spinner(1, &sensor_queue);
+    ros::AsyncSpinner objects_spinner(1, &objects_queue);
+    ros::AsyncSpinner latest_objects_spinner(1, &latest_objects_queue);
+    ros::AsyncSpinner poses_spinner(1, &poses_queue);
+    ros::AsyncSpinner all_poses_spinner(1, &all_poses_queue);
+    ros::AsyncSpinner visualization_spinner(1, &visualization_queue);
+    ros::AsyncSpinner dump_spinner(1, &dump_queue);
+    sensor_spinner.start();
+    objects_spinner.start();
+    latest_objects_spinner.start();
+    poses_spinner.start();
+    all_poses_spinner.start();
+    visualization_spinner.start();
+    dump_spinner.start();
+
+    ros::waitForShutdown();
+
+    if (continuous_thread.joinable()) {
+        continuous_thread.join();
+    }
+    snapshot_writer.reset(); // saves what is still queued
+    flight_recorder.reset();
 
-    ros::Rate r(2.0);
+}
 
-    std::string train_directory = "../../common_suturo1718/pcd_files";
-    my_classifier.train(train_directory, false);
+/**
+ * Connect callback of the debugging topics. The current cloud is sent again with the next timer event,
+ * so the new subscriber gets it even if it didn't change.
+ * @param topic the subscriber connected to
+ * @param subscriber unused
+ */
+void debugSubscriberConnected(DebugTopic *topic, const ros::SingleSubscriberPublisher &subscriber) {
+    topic->new_subscriber = true;
+}
 
-    ROS_INFO("%sVision is ready!\n", "\x1B[32m");
+/**
+ * Publishes a debugging cloud, but only if somebody listens and it hasn't been published yet.
+ * New subscribers get the current cloud, even if it didn't change.
+ * @param topic
+ * @param cloud
+ */
+template<typename PointT>
+void publishDebugCloud(DebugTopic &topic, const boost::shared_ptr<pcl::PointCloud<PointT> > &cloud) {
+    if (topic.publisher.getNumSubscribers() == 0 || !cloud) {
+        return;
+    }
+    if (topic.last_cloud.lock() == cloud && !topic.new_subscriber) {
+        return;
+    }
+    topic.last_cloud = cloud;
+    topic.new_subscriber = false;
+
+    sensor_msgs::PointCloud2 cloud_pub;
+    if (debug_voxel_size > 0.0) {
+        pcl::PointCloud<PointT> downsampled;
+        pcl::VoxelGrid<PointT> sor;
+        sor.setInputCloud(cloud);
+        sor.setLeafSize(debug_voxel_size, debug_voxel_size, debug_voxel_size);
+        sor.filter(downsampled);
+        pcl::toROSMsg(downsampled, cloud_pub);
+    } else {
+        pcl::toROSMsg(*cloud, cloud_pub);
+    }
+    cloud_pub.header.frame_id = "head_mount_kinect_rgb_optical_frame";
+    topic.publisher.publish(cloud_pub);
+}
 
+/**
+ * Timer callback publishing the clouds and the pose for debugging purposes.
+ * @param event unused
+ */
+void publishVisualization(const ros::TimerEvent &event) {
+    PointCloudRGBNormalPtr final_cloud;
+    PointCloudRGBPtr perceived_cloud, mesh_cloud, aligned_cloud;
+    geometry_msgs::PoseStamped pose;
+    {
+        boost::mutex::scoped_lock lock(debug_clouds_mutex);
+        final_cloud = cloud_global;
+        perceived_cloud = cloud_perceived;
+        mesh_cloud = cloud_mesh;
+        aligned_cloud = cloud_aligned;
+        pose = pose_global;
+    }
 
-    while (n.ok()) {
-        sensor_msgs::PointCloud2 cloud_final_pub;
-        //ROS_INFO("%lu points", cloud_global->points.size());
+    publishDebugCloud(topic_visualization_object, final_cloud);
+    publishDebugCloud(topic_perceived_object, perceived_cloud);
+    publishDebugCloud(topic_mesh_object, mesh_cloud);
+    publishDebugCloud(topic_aligned_object, aligned_cloud);
 
-        pcl::toROSMsg(*cloud_global, cloud_final_pub);
-        cloud_final_pub.header.frame_id = "head_mount_kinect_rgb_optical_frame";
-        pub_visualization_object.publish(cloud_final_pub);
+    pub_pose.publish(pose);
+    broadcastObjectPose(pose);
+}
 
+/**
+ * Runs the whole perception on the latest kinect frame: finds the objects and classifies them.
+ * Only one run at a time, as the pipeline keeps state between frames.
+ * @param result returns the objects, their labels and the capture time of the frame.
+ * If there was no usable frame, its error says why.
+ * @return false if there was no usable frame
+ */
+bool perceiveObjects(PerceptionResult &result) {
+    boost::mutex::scoped_lock lock(pipeline_mutex);
+    error_message = ""; // only the errors of this run
 
-        sensor_msgs::PointCloud2 cloud_perceived_pub;
-        //ROS_INFO("%lu points", cloud_perceived->points.size());
+    if (!updateScene() || scene->size() == 0) {
+        ROS_ERROR("Kinect has no image");
+        error_message = "No image from kinect. ";
+        result.error = error_message;
+        return false;
+    }
+    result.stamp = scene_msg->header.stamp;
+    if (snapshot_writer) {
+        snapshot_writer->beginFrame(result.stamp);
+    }
+    if (flight_recorder) {
+        flight_recorder->beginFrame(scene_msg);
+    }
 
-        pcl::toROSMsg(*cloud_perceived, cloud_perceived_pub);
-        cloud_perceived_pub.header.frame_id = "head_mount_kinect_rgb_optical_frame";
-        pub_perceived_object.publish(cloud_perceived_pub);
+    // If PR2 is not looking at anything.
+    // This causes the whole segmentation and filtering process to be skipped if the cloud is empty
+    // or too small to work on.
+    if (scene->points.size() < 500) {
+        ROS_ERROR("Input from kinect is empty");
+        error_message = "Cloud empty. ";
+        result.error = error_message;
+        reportFailure("cloud empty");
+        return false;
+    }
+    // Search trees are shared by all stages working on this frame
+    SearchCache search_cache;
 
-        sensor_msgs::PointCloud2 cloud_mesh_pub;
-        //ROS_INFO("%lu points", cloud_aligned->points.size());
+    // Execute findCluster()
+    result.clusters = findCluster(scene, *cloud_transformer, search_cache, plane_hints, cropped_buffer);
+    ROS_INFO("Suturo Vision: findCluster completed!");
+    if (result.clusters.empty()) {
+        reportFailure("no objects found");
+    }
 
-        pcl::toROSMsg(*cloud_mesh, cloud_mesh_pub);
-        cloud_mesh_pub.header.frame_id = "head_mount_kinect_rgb_optical_frame";
-        pub_mesh_object.publish(cloud_mesh_pub);
+    // Calculate the features of all objects at the same time. Every task writes straight into
+    // its own row of the feature matrices, so the rows are in the order of the clusters.
+    int object_amount = result.clusters.size();
+    cv::Mat color_features(object_amount, COLOR_FEATURES_PER_OBJECT, CV_32FC1);
+    cv::Mat cvfh_features(object_amount, CVFH_FEATURES_PER_OBJECT, CV_32FC1);
+    std::vector<WorkerPool::Task> tasks;
+    for (int a = 0; a < object_amount; a++) {
+        tasks.push_back(boost::bind(&getObjectFeatures, result.clusters[a], &search_cache,
+                                    cvfh_features.ptr<float>(a), color_features.ptr<float>(a)));
+    }
+    worker_pool->run(tasks);
+    ROS_INFO("Suturo Vision: %d search trees built, %d reused", search_cache.getBuilds(), search_cache.getHits());
 
-        sensor_msgs::PointCloud2 cloud_aligned_pub;
-        //ROS_INFO("%lu points", cloud_aligned->points.size());
+    // Classify all objects in one pass
+    BatchClassification classification;
+    my_classifier.classifyBatch(color_features, cvfh_features, classification);
+    result.labels = classification.labels;
+    result.error = error_message;
 
-        pcl::toROSMsg(*cloud_aligned, cloud_aligned_pub);
-        cloud_aligned_pub.header.frame_id = "head_mount_kinect_rgb_optical_frame";
-        pub_aligned_object.publish(cloud_aligned_pub);
+    return true;
+}
 
-        pub_pose.publish(pose_global);
+/**
+ * Lets the flight recorder save the recent frames in the background, if ~dump_on_failure is set.
+ * @param reason is logged
+ */
+void reportFailure(const std::string &reason) {
+    if (dump_on_failure && flight_recorder) {
+        flight_recorder->requestDump(reason, dump_interval);
+    }
+}
 
+/**
+ * Background thread of the continuous mode. Runs the perception whenever a new kinect frame
+ * has arrived and keeps the result in latest_result.
+ */
+void continuousPerception() {
+    sensor_msgs::PointCloud2ConstPtr last_msg;
+    while (ros::ok()) {
+        {
+            boost::mutex::scoped_lock lock(kinect_msg_mutex);
+            if (kinect_msg == last_msg) {
+                kinect_msg_condition.timed_wait(lock, boost::posix_time::milliseconds(100));
+                continue;
+            }
+            last_msg = kinect_msg;
+        }
 
-        ros::spinOnce();
-        r.sleep();
+        boost::shared_ptr<PerceptionResult> result(new PerceptionResult);
+        if (perceiveObjects(*result)) {
+            boost::mutex::scoped_lock lock(latest_result_mutex);
+            latest_result = result;
+        }
     }
+}
 
+/**
+ * Gets a perception result that is at most max_age seconds old.
+ * The result of the continuous mode is used if it is fresh enough, otherwise the perception runs now.
+ * @param max_age in seconds. 0 always runs the perception, a negative age takes any result there is.
+ * @param result returns the objects and their labels
+ * @param from_cache returns whether the result came from the continuous mode
+ * @return false if there was no usable frame
+ */
+bool getPerceptionResult(double max_age, PerceptionResult &result, bool &from_cache) {
+    boost::shared_ptr<const PerceptionResult> cached;
+    {
+        boost::mutex::scoped_lock lock(latest_result_mutex);
+        cached = latest_result;
+    }
+    from_cache = cached && max_age != 0.0 && (max_age < 0.0 || (ros::Time::now() - cached->stamp).toSec() <= max_age);
+    if (from_cache) {
+        result = *cached;
+        return true;
+    }
+    return perceiveObjects(result);
 }
 
 /**
  * Service to extract objects from scene to work with and to get all required information from them.
+ * In the continuous mode the latest result is returned right away, if it's not older than ~max_result_age.
  * @param req empty request
  * @param res returns all members from ObjectsInfo.msg
  * @return true if service call succeeded, false otherwise
  */
 bool getObjects(vision_suturo_msgs::objects::Request &req, vision_suturo_msgs::objects::Response &res) {
-
-    // If PR2 is not looking at anything.
-    // This causes the whole segmentation and filtering process to be skipped if the cloud is empty
-    // or too small to work on.
-    if (scene->points.size() < 500) {
-        ROS_ERROR("Input from kinect is empty");
-        error_message = "Cloud empty. ";
-        // res.clouds.object_error = error_message;
+    PerceptionResult result;
+    bool from_cache;
+    if (!getPerceptionResult(max_result_age, result, from_cache)) {
+        res.clouds.object_errors = result.error;
         return true;
     }
-    // Execute findCluster()
-    all_clusters = findCluster(scene);
-    ROS_INFO("Suturo Vision: findCluster completed!");
+    {
+        boost::mutex::scoped_lock lock(all_clusters_mutex);
+        all_clusters = result.clusters;
+        all_labels = result.labels;
+    }
 
-    // Calculate features and put them into the message response
-    std::vector<float> current_features_vector = getCVFHFeatures(all_clusters);
-    std::vector<uint64_t> color_features_vector = getColorFeatures(all_clusters);
-
-    std::vector<float> single_cvfh_features;
-    std::vector<uint64_t> single_color_features;
-    std::vector<std::string> classifier_results;
-    for (int a = 0; a < all_clusters.size(); a++) { // Get histograms of each object and classify
-        single_cvfh_features.clear();
-        single_color_features.clear();
-        for (int b = 0; b < 24; b++) {
-            single_color_features.push_back(color_features_vector[b + (a * 24)]);
-        }
-        for (int c = 0; c < 308; c++) {
-            single_cvfh_features.push_back(current_features_vector[c + (a * 308)]);
-        }
+    res.clouds.labels = result.labels;
+    res.clouds.object_amount = result.clusters.size();
+    res.clouds.object_errors = result.error;
+
+    return true;
+
+}
 
-        classifier_results.push_back(my_classifier.classify(single_color_features, single_cvfh_features));
+/**
+ * Service like getObjects, which also tells how old the result is and lets the caller decide how old it may be.
+ * @param req max_age of the result in seconds, 0 forces a new run, a negative age takes any result
+ * @param res labels and amount of the objects, capture time and age of the frame
+ * @return true if service call succeeded, false otherwise
+ */
+bool getLatestObjects(vision_suturo::latest_objects::Request &req, vision_suturo::latest_objects::Response &res) {
+    PerceptionResult result;
+    if (!getPerceptionResult(req.max_age, result, res.from_cache)) {
+        res.error = result.error;
+        return true;
+    }
+    {
+        boost::mutex::scoped_lock lock(all_clusters_mutex);
+        all_clusters = result.clusters;
+        all_labels = result.labels;
     }
 
-    res.clouds.labels = classifier_results;
-    res.clouds.object_amount = all_clusters.size();
-    //res.clouds.object_errors = error_message;
+    res.labels = result.labels;
+    res.object_amount = result.clusters.size();
+    res.stamp = result.stamp;
+    res.age = (ros::Time::now() - result.stamp).toSec();
+    res.error = result.error;
 
     return true;
-
 }
 
 bool getPoses(vision_suturo_msgs::poses::Request &req, vision_suturo_msgs::poses::Response &res) {
     // Get poses for the objects
     // Currently computes all centroids, but only takes the relevant one.
 
-    if (!all_clusters.empty()) { // If objects have been perceived
+    PointCloudRGBNormalPtr cluster;
+    {
+        boost::mutex::scoped_lock lock(all_clusters_mutex);
+        if (req.index >= 0 && static_cast<size_t>(req.index) < all_clusters.size()) {
+            cluster = all_clusters[req.index];
+        }
+    }
 
-        geometry_msgs::PoseStamped pose = findPose(all_clusters[req.index], req.labels);
+    if (cluster) { // If objects have been perceived
+
+        geometry_msgs::PoseStamped pose = findPose(cluster, req.labels);
         res.object_pose = pose;
     } else {
         geometry_msgs::PoseStamped dummy_pose;
@@ -193,3 +553,66 @@ bool getPoses(vision_suturo_msgs::poses::Request &req, vision_suturo_msgs::poses
 
     return true;
 }
+
+/**
+ * Service to get the poses of all objects found by the last getObjects call at once.
+ * The alignments run in parallel, every one with its own state.
+ * @param req labels of the objects, the classifier results are used if empty
+ * @param res one pose, label and error message per object
+ * @return true if service call succeeded, false otherwise
+ */
+bool getAllPoses(vision_suturo::all_poses::Request &req, vision_suturo::all_poses::Response &res) {
+    std::vector<PointCloudRGBNormalPtr> clusters;
+    std::vector<std::string> labels;
+    {
+        boost::mutex::scoped_lock lock(all_clusters_mutex);
+        clusters = all_clusters;
+        labels = req.labels.empty() ? all_labels : req.labels;
+    }
+
+    if (clusters.empty()) {
+        ROS_WARN("Returned no poses. Call 'vision_suturo/objects_information' first!");
+        return true;
+    }
+
+    if (labels.size() != clusters.size()) {
+        ROS_ERROR("Got %lu labels for %lu objects", labels.size(), clusters.size());
+        return false;
+    }
+
+    std::vector<PoseEstimate> estimates(clusters.size());
+    std::vector<WorkerPool::Task> tasks;
+    for (int a = 0; a < clusters.size(); a++) {
+        tasks.push_back(boost::bind(&estimatePose, clusters[a], boost::cref(labels[a]),
+                                    boost::ref(estimates[a])));
+    }
+    worker_pool->run(tasks);
+
+    for (int a = 0; a < estimates.size(); a++) {
+        res.object_poses.push_back(estimates[a].pose);
+        res.errors.push_back(estimates[a].error);
+    }
+    res.labels = labels;
+
+    return true;
+}
+
+/**
+ * Service saving the frames kept by the flight recorder, e.g. after the perception did something odd.
+ * @param req empty request
+ * @param res returns the folder the frames were saved in
+ * @return true if service call succeeded, false otherwise
+ */
+bool dumpFlightRecorder(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res) {
+    if (!flight_recorder) {
+        res.success = false;
+        res.message = "Flight recorder is disabled, set ~flight_recorder_frames";
+        return true;
+    }
+    res.message = flight_recorder->dump("requested");
+    res.success = !res.message.empty();
+    if (!res.success) {
+        res.message = "Nothing was saved";
+    }
+    return true;
+}
@@ -3,17 +3,64 @@
 #include "object_detection/ObjectDetection.h"
 #include "object_detection/VisObjectInfo.h"
 #include <pcl_ros/point_cloud.h>
+#include <ros/package.h>
+#include <ros/callback_queue.h>
+#include <std_srvs/Trigger.h>
 #include <visualization_msgs/Marker.h>
 #include <vision_suturo_msgs/objects.h>
 #include <vision_suturo_msgs/poses.h>
+#include <vision_suturo/all_poses.h>
+#include <vision_suturo/latest_objects.h>
 #include "../viewer/viewer.h"
 #include "../perception/perception.h"
 #include "../perception/short_types.h"
 #include "../recognition/classifier.h"
+#include "../parallel/worker_pool.h"
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/**
+ * Topic of a debugging cloud. Remembers what has been published last,
+ * so the same cloud isn't serialized again.
+ */
+struct DebugTopic {
+    ros::Publisher publisher;
+    boost::weak_ptr<const void> last_cloud; // doesn't keep the cloud alive
+    bool new_subscriber;                    // set by the connect callback, the cloud is sent again
+
+    DebugTopic() : new_subscriber(false) {}
+};
+
+/**
+ * Objects found in one kinect frame.
+ */
+struct PerceptionResult {
+    std::vector<PointCloudRGBNormalPtr> clusters;
+    std::vector<std::string> labels; // classifier result of every cluster
+    ros::Time stamp;                 // capture time of the kinect frame
+    std::string error;               // errors of the run that produced it, empty if there were none
+};
 
 bool getObjects(vision_suturo_msgs::objects::Request &req, vision_suturo_msgs::objects::Response &res);
 bool getPoses(vision_suturo_msgs::poses::Request &req, vision_suturo_msgs::poses::Response &res);
-void sub_kinect_callback(sensor_msgs::PointCloud2 kinect);
+bool getLatestObjects(vision_suturo::latest_objects::Request &req, vision_suturo::latest_objects::Response &res);
+bool getAllPoses(vision_suturo::all_poses::Request &req, vision_suturo::all_poses::Response &res);
+bool dumpFlightRecorder(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res);
+void debugSubscriberConnected(DebugTopic *topic, const ros::SingleSubscriberPublisher &subscriber);
+void sub_kinect_callback(const sensor_msgs::PointCloud2ConstPtr &kinect);
+bool updateScene();
+bool perceiveObjects(PerceptionResult &result);
+void continuousPerception();
+bool getPerceptionResult(double max_age, PerceptionResult &result, bool &from_cache);
+void broadcastObjectPose(const geometry_msgs::PoseStamped &pose);
+void publishVisualization(const ros::TimerEvent &event);
+void startSnapshotWriter(const std::string &format, const std::string &stages, int queue_size);
+void reportFailure(const std::string &reason);
 void start_node(int argc, char **argv);
 
 #endif //VISION_VISION_NODE_H
@@ -0,0 +1,105 @@
+#include "worker_pool.h"
+
+#include <boost/bind.hpp>
+
+#include <stdexcept>
+
+/**
+ * Starts the worker threads.
+ * @param threads number of threads, 0 uses one thread per core
+ */
+WorkerPool::WorkerPool(unsigned int threads) : stopping_(false) {
+    if (threads == 0) {
+        threads = boost::thread::hardware_concurrency();
+    }
+    if (threads == 0) { // hardware_concurrency() couldn't find out
+        threads = 1;
+    }
+    size_ = threads;
+    for (unsigned int i = 0; i < size_; i++) {
+        threads_.create_thread(boost::bind(&WorkerPool::work, this));
+    }
+}
+
+/**
+ * Lets the workers finish the queued tasks and joins them.
+ */
+WorkerPool::~WorkerPool() {
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        stopping_ = true;
+    }
+    task_available_.notify_all();
+    threads_.join_all();
+}
+
+/**
+ * Runs all tasks on the workers and waits until they are done.
+ * If a task throws, the others still run and the first error is thrown afterwards.
+ * @param tasks
+ */
+void WorkerPool::run(const std::vector<Task> &tasks) {
+    if (tasks.empty()) {
+        return;
+    }
+
+    Batch batch;
+    batch.remaining = tasks.size();
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        for (size_t i = 0; i < tasks.size(); i++) {
+            queue_.push_back(std::make_pair(tasks[i], &batch));
+        }
+    }
+    task_available_.notify_all();
+
+    boost::mutex::scoped_lock lock(mutex_);
+    while (batch.remaining > 0) {
+        batch_done_.wait(lock);
+    }
+    if (!batch.error.empty()) {
+        throw std::runtime_error(batch.error);
+    }
+}
+
+/**
+ * @return Number of worker threads
+ */
+unsigned int WorkerPool::size() const {
+    return size_;
+}
+
+void WorkerPool::work() {
+    while (true) {
+        std::pair<Task, Batch *> item;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            while (queue_.empty() && !stopping_) {
+                task_available_.wait(lock);
+            }
+            if (queue_.empty()) { // stopping and nothing left to do
+                return;
+            }
+            item = queue_.front();
+            queue_.pop_front();
+        }
+
+        std::string error;
+        try {
+            item.first();
+        } catch (std::exception &e) {
+            error = e.what();
+        } catch (...) {
+            error = "unknown exception in worker task";
+        }
+
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (!error.empty() && item.second->error.empty()) {
+                item.second->error = error;
+            }
+            item.second->remaining--;
+        }
+        batch_done_.notify_all();
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef VISION_WORKER_POOL_H
+#define VISION_WORKER_POOL_H
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * A fixed number of worker threads that run batches of tasks.
+ * run() blocks until every task of its batch has finished, so results can be written
+ * into slots that belong to the task and keep their order.
+ */
+class WorkerPool {
+public:
+    typedef boost::function<void()> Task;
+
+    explicit WorkerPool(unsigned int threads = 0);
+    ~WorkerPool();
+    void run(const std::vector<Task> &tasks);
+    unsigned int size() const;
+
+private:
+    struct Batch {
+        size_t remaining;
+        std::string error;
+    };
+
+    void work();
+
+    std::deque<std::pair<Task, Batch *> > queue_;
+    boost::thread_group threads_;
+    boost::mutex mutex_;
+    boost::condition_variable task_available_;
+    boost::condition_variable batch_done_;
+    unsigned int size_;
+    bool stopping_;
+};
+
+#endif //VISION_WORKER_POOL_H
@@ -0,0 +1,91 @@
+#include "color_histogram.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Points are spread over this many partial histograms, so consecutive points that fall into
+// the same bin don't have to wait for each other's increment.
+const int PARTIAL_HISTOGRAMS = 4;
+
+/**
+ * Converts a color to hue (0 to 359), saturation and value (0 to 255).
+ */
+static inline void rgbToHsv(int r, int g, int b, int &h, int &s, int &v) {
+    int max = std::max(r, std::max(g, b));
+    int min = std::min(r, std::min(g, b));
+    int delta = max - min;
+    v = max;
+    s = max == 0 ? 0 : (255 * delta) / max;
+    if (delta == 0) {
+        h = 0;
+    } else if (max == r) {
+        h = (60 * (g - b) / delta + 360) % 360;
+    } else if (max == g) {
+        h = 60 * (b - r) / delta + 120;
+    } else {
+        h = 60 * (r - g) / delta + 240;
+    }
+}
+
+/**
+ * Computes the color histogram of packed rgba values.
+ * Bins are looked up in tables instead of being found by comparisons, so there are no branches per point
+ * for rgb. The rgba field is read as one 32 bit value and the channels are taken out by shifting.
+ * @param first_rgba address of the rgba field of the first point
+ * @param stride bytes from one point to the next
+ * @param count number of points
+ * @param config binning and color space
+ * @param histogram config.size() bins, to be filled
+ */
+void computeColorHistogram(const uint8_t *first_rgba,
+                           size_t stride,
+                           size_t count,
+                           const ColorHistogramConfig &config,
+                           uint64_t *histogram) {
+    const int bins = std::max(1, std::min(config.bins, 256));
+    const int size = 3 * bins;
+
+    // Bin of every possible channel value
+    uint16_t channel_bin[256];
+    for (int value = 0; value < 256; value++) {
+        channel_bin[value] = static_cast<uint16_t>((value * bins) >> 8);
+    }
+    uint16_t hue_bin[360];
+    for (int hue = 0; hue < 360; hue++) {
+        hue_bin[hue] = static_cast<uint16_t>((hue * bins) / 360);
+    }
+
+    std::vector<uint32_t> partial(PARTIAL_HISTOGRAMS * size, 0);
+    uint32_t *partial_first = &partial[0];
+    uint32_t *partial_second = partial_first + bins;
+    uint32_t *partial_third = partial_first + 2 * bins;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t rgba;
+        std::memcpy(&rgba, first_rgba + i * stride, sizeof(rgba));
+        const int r = (rgba >> 16) & 0xff;
+        const int g = (rgba >> 8) & 0xff;
+        const int b = rgba & 0xff;
+        const size_t offset = (i % PARTIAL_HISTOGRAMS) * size;
+
+        if (config.color_space == COLOR_SPACE_HSV) {
+            int h, s, v;
+            rgbToHsv(r, g, b, h, s, v);
+            partial_first[offset + hue_bin[h]]++;
+            partial_second[offset + channel_bin[s]]++;
+            partial_third[offset + channel_bin[v]]++;
+        } else {
+            partial_first[offset + channel_bin[r]]++;
+            partial_second[offset + channel_bin[g]]++;
+            partial_third[offset + channel_bin[b]]++;
+        }
+    }
+
+    for (int bin = 0; bin < size; bin++) {
+        uint64_t sum = 0;
+        for (int p = 0; p < PARTIAL_HISTOGRAMS; p++) {
+            sum += partial[p * size + bin];
+        }
+        histogram[bin] = sum;
+    }
+}
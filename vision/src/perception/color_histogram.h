@@ -0,0 +1,58 @@
+#ifndef VISION_COLOR_HISTOGRAM_H
+#define VISION_COLOR_HISTOGRAM_H
+
+#include <pcl/point_cloud.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Color histograms of PointClouds. Used by the vision node and the batch_processor,
+ * so the features used for training and at runtime are computed by the same code.
+ */
+
+enum ColorSpace {
+    COLOR_SPACE_RGB,
+    COLOR_SPACE_HSV
+};
+
+/**
+ * How the histogram is binned. The default (8 bins per r, g and b) is what the classifier was trained with.
+ */
+struct ColorHistogramConfig {
+    int bins;               // bins per channel, 1 to 256
+    ColorSpace color_space;
+
+    ColorHistogramConfig() : bins(8), color_space(COLOR_SPACE_RGB) {}
+    int size() const { return 3 * bins; }
+};
+
+void computeColorHistogram(const uint8_t *first_rgba,
+                           size_t stride,
+                           size_t count,
+                           const ColorHistogramConfig &config,
+                           uint64_t *histogram);
+
+/**
+ * Computes the color histogram of a PointCloud. The channels are concatenated,
+ * e.g. 8 bins of red, then 8 of green, then 8 of blue.
+ * @param cloud PointCloud of any point type with an rgba field
+ * @param config binning and color space
+ * @return config.size() bin counts
+ */
+template<typename PointT>
+std::vector<uint64_t> computeColorHistogram(const pcl::PointCloud<PointT> &cloud,
+                                            const ColorHistogramConfig &config = ColorHistogramConfig()) {
+    std::vector<uint64_t> histogram(config.size(), 0);
+    if (!cloud.points.empty()) {
+        computeColorHistogram(reinterpret_cast<const uint8_t *>(&cloud.points[0].rgba),
+                              sizeof(PointT),
+                              cloud.points.size(),
+                              config,
+                              &histogram[0]);
+    }
+    return histogram;
+}
+
+#endif //VISION_COLOR_HISTOGRAM_H
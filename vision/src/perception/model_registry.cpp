@@ -0,0 +1,109 @@
+#include "model_registry.h"
+#include "perception_core.h"
+
+#include <pcl/common/centroid.h>
+#include <pcl/common/io.h>
+#include <pcl/io/pcd_io.h>
+
+/**
+ * Mesh file of every label the classifier knows.
+ * Both Pringles share one mesh, Kellogg's is listed with the spelling of the classifier and the correct one.
+ */
+static const char *MESH_FILES[][2] = {{"CupEcoOrange",                 "cup_eco_orange.pcd"},
+                                      {"EdekaRedBowl",                 "edeka_red_bowl.pcd"},
+                                      {"HelaCurryKetchup",             "hela_curry_ketchup.pcd"},
+                                      {"JaMilch",                      "ja_milch.pcd"},
+                                      {"KellogsToppasMini",            "kelloggs_toppas_mini.pcd"},
+                                      {"KelloggsToppasMini",           "kelloggs_toppas_mini.pcd"},
+                                      {"KoellnMuesliKnusperHonigNuss", "koelln_muesli_knusper_honig_nuss.pcd"},
+                                      {"PringlesPaprika",              "pringles.pcd"},
+                                      {"PringlesSalt",                 "pringles.pcd"},
+                                      {"SiggBottle",                   "sigg_bottle.pcd"},
+                                      {"TomatoSauceOroDiParma",        "tomato_sauce_oro_di_parma.pcd"}};
+
+/**
+ * Flips every normal of a mesh that points towards its centroid.
+ * NormalEstimation orients them towards the origin, which lies inside the meshes, while the normals
+ * of the scene point towards the kinect and so out of the objects. FPFH depends on their sign.
+ * @param mesh with normals
+ */
+static void orientNormalsOutwards(PointCloudRGBNormal &mesh) {
+    Eigen::Vector4f centroid;
+    pcl::compute3DCentroid(mesh, centroid);
+    for (size_t i = 0; i < mesh.points.size(); i++) {
+        pcl::PointXYZRGBNormal &point = mesh.points[i];
+        if (point.getNormalVector3fMap().dot(point.getVector3fMap() - centroid.head<3>()) < 0.0f) {
+            point.getNormalVector3fMap() *= -1.0f;
+        }
+    }
+}
+
+/**
+ * Loads the meshes of all labels and prepares them for the alignment.
+ * Every file is only loaded once, even if several labels use it.
+ * @param directory containing the mesh PCD files, ending with a slash
+ * @param config downsampling of the ICP levels and the features
+ * @return false if a mesh couldn't be loaded. The other meshes are available anyway.
+ */
+bool ModelRegistry::load(const std::string &directory, const ModelRegistryConfig &config) {
+    std::map<std::string, boost::shared_ptr<ObjectModel> > models_by_file;
+    bool complete = true;
+    models_.clear();
+
+    for (size_t i = 0; i < sizeof(MESH_FILES) / sizeof(MESH_FILES[0]); i++) {
+        const std::string label = MESH_FILES[i][0];
+        const std::string file = MESH_FILES[i][1];
+
+        boost::shared_ptr<ObjectModel> &model = models_by_file[file];
+        if (!model) {
+            PointCloudRGBPtr mesh(new PointCloudRGB);
+            if (pcl::io::loadPCDFile(directory + file, *mesh) < 0 || mesh->points.empty()) {
+                PCL_ERROR("Model registry: can't load the mesh %s%s\n", directory.c_str(), file.c_str());
+                models_by_file.erase(file);
+                complete = false;
+                continue;
+            }
+
+            model.reset(new ObjectModel);
+            model->file = file;
+            model->cloud.reset(new PointCloudRGBNormal);
+            pcl::concatenateFields(*mesh, *estimateSurfaceNormals(mesh, config.normal_radius), *model->cloud);
+            orientNormalsOutwards(*model->cloud);
+            for (size_t level = 0; level < config.leaf_sizes.size(); level++) {
+                PointCloudRGBNormalPtr level_cloud = voxelGridFilterWithNormals(model->cloud,
+                                                                                config.leaf_sizes[level]);
+                ObjectModel::KdTree::Ptr tree(new ObjectModel::KdTree);
+                tree->setInputCloud(level_cloud);
+                model->levels.push_back(level_cloud);
+                model->trees.push_back(tree);
+            }
+            if (config.compute_features) {
+                model->feature_cloud = voxelGridFilterWithNormals(model->cloud, config.feature_leaf_size);
+                model->features = computeFPFHFeatures(model->feature_cloud, config.feature_radius);
+            }
+            PCL_INFO("Model registry: loaded %s with %lu points\n", file.c_str(), model->cloud->points.size());
+        }
+        models_[label] = model;
+    }
+
+    return complete;
+}
+
+/**
+ * @param label as returned by the classifier
+ * @return The model of the label, or NULL if there is none
+ */
+const ObjectModel *ModelRegistry::get(const std::string &label) const {
+    std::map<std::string, boost::shared_ptr<ObjectModel> >::const_iterator model = models_.find(label);
+    if (model == models_.end()) {
+        return NULL;
+    }
+    return model->second.get();
+}
+
+/**
+ * @return Number of labels that have a model
+ */
+size_t ModelRegistry::size() const {
+    return models_.size();
+}
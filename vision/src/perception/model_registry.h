@@ -0,0 +1,61 @@
+#ifndef VISION_MODEL_REGISTRY_H
+#define VISION_MODEL_REGISTRY_H
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/search/kdtree.h>
+#include <boost/shared_ptr.hpp>
+
+#include "short_types.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Mesh of an object, prepared for the alignment.
+ * Its normals point out of the object, like the ones of the scene.
+ * levels[i] is the mesh downsampled for ICP level i, trees[i] is its KdTree.
+ * features are the FPFH features of feature_cloud, used for the global alignment.
+ * Both are only set if the registry was loaded with compute_features.
+ */
+struct ObjectModel {
+    typedef pcl::search::KdTree<pcl::PointXYZRGBNormal> KdTree;
+
+    std::string file;
+    PointCloudRGBNormalPtr cloud; // full resolution, with normals
+    std::vector<PointCloudRGBNormalPtr> levels;
+    std::vector<KdTree::Ptr> trees;
+    PointCloudRGBNormalPtr feature_cloud;
+    PointCloudFPFHPtr features;
+};
+
+/**
+ * How the meshes are prepared.
+ */
+struct ModelRegistryConfig {
+    std::vector<float> leaf_sizes; // voxel size of every ICP level, 0 keeps the full resolution
+    float normal_radius;           // neighborhood of the normals of the meshes
+    bool compute_features;         // FPFH features for the global alignment, takes a while per mesh
+    float feature_leaf_size;       // voxel size of the cloud the FPFH features are computed on
+    float feature_radius;          // radius of the FPFH features
+
+    ModelRegistryConfig() : normal_radius(0.03f), compute_features(false), feature_leaf_size(0.01f), feature_radius(0.025f) {}
+};
+
+/**
+ * All object meshes, keyed by the labels of the classifier.
+ * The meshes are loaded and prepared once when the node starts, so pose requests never touch the disk
+ * and never build a KdTree over a mesh. After load() it is only read, so it can be shared by threads.
+ */
+class ModelRegistry {
+public:
+    bool load(const std::string &directory, const ModelRegistryConfig &config);
+    const ObjectModel *get(const std::string &label) const;
+    size_t size() const;
+
+private:
+    std::map<std::string, boost::shared_ptr<ObjectModel> > models_;
+};
+
+#endif //VISION_MODEL_REGISTRY_H
@@ -1,113 +1,166 @@
 #include "perception.h"
 
-std::string mesh_array[] = {"cup_eco_orange.pcd",
-                            "edeka_red_bowl.pcd",
-                            "hela_curry_ketchup.pcd",
-                            "ja_milch.pcd",
-                            "kellogs_toppas_mini.pcd",
-                            "koelln_muesli_knusper_honig_nuss.pcd",
-                            "pringles_paprika.pcd",
-                            "pringles_salt.pcd",
-                            "sigg_bottle.pcd",
-                            "tomato_sauce_oro_di_parma.pcd"};
-
-PointCloudRGBPtr cloud_global(new PointCloudRGB),
-        cloud_perceived(new PointCloudRGB),
+PointCloudRGBNormalPtr cloud_global(new PointCloudRGBNormal);
+PointCloudRGBPtr cloud_perceived(new PointCloudRGB),
         cloud_aligned(new PointCloudRGB),
         cloud_mesh(new PointCloudRGB);
 geometry_msgs::PoseStamped pose_global;
 
+PerceptionParams perception_params;
+ModelRegistry model_registry;
+
+// Guards the clouds and the pose above, which are published for debugging by another thread
+boost::mutex debug_clouds_mutex;
+
 std::string error_message; // Used by the objects_information service
 tf::Matrix3x3 global_tf_rotation;
 
+/**
+ * Replaces the cloud that is published as the final result of the segmentation.
+ * @param cloud
+ */
+static void setDebugCloud(const PointCloudRGBNormalPtr &cloud) {
+    boost::mutex::scoped_lock lock(debug_clouds_mutex);
+    cloud_global = cloud;
+}
+
+/**
+ * Rotation part of a transformation.
+ * @param transformation
+ * @return 3x3 rotation matrix
+ */
+static tf::Matrix3x3 rotationOf(const Eigen::Matrix4f &transformation) {
+    return tf::Matrix3x3(transformation(0, 0), transformation(0, 1), transformation(0, 2),
+                         transformation(1, 0), transformation(1, 1), transformation(1, 2),
+                         transformation(2, 0), transformation(2, 1), transformation(2, 2));
+}
+
 /**
  * Applies all the filters to a PointCloud.
  * @param kinect PointCloud
+ * @param cropped_buffer output of the crop filter, reused so its memory is only allocated once
  * @return Preprocessed PointCloud
  */
-PointCloudRGBPtr preprocessCloud(PointCloudRGBPtr kinect) {
+PointCloudRGBNormalPtr preprocessCloud(PointCloudRGBPtr kinect, PointCloudRGBPtr cropped_buffer) {
     PointCloudRGBPtr cloud_3df(new PointCloudRGB),
-            cloud_voxelgridf(new PointCloudRGB),
-            cloud_mlsf(new PointCloudRGB),
-            cloud_prism(new PointCloudRGB),
-            cloud_preprocessed(new PointCloudRGB);
-    cloud_3df = apply3DFilter(kinect, 0.4, 0.4, 1.5);   // passthrough filter
-    cloud_voxelgridf = voxelGridFilter(cloud_3df);      // voxel grid filter
-    cloud_mlsf = mlsFilter(cloud_voxelgridf);           // moving least square filter
+            cloud_voxelgridf(new PointCloudRGB);
+    PointCloudRGBNormalPtr cloud_mlsf(new PointCloudRGBNormal),
+            cloud_preprocessed(new PointCloudRGBNormal);
+    cloud_3df = apply3DFilter(kinect, 0.4, 0.4, 1.5, false, cropped_buffer); // crop filter
+    cloud_voxelgridf = voxelGridFilter(cloud_3df, perception_params.core.voxel_leaf_size); // voxel grid filter
+    cloud_mlsf = mlsFilter(cloud_voxelgridf, perception_params.core); // moving least square filter, also computes normals
     cloud_preprocessed = cloud_mlsf;
     return cloud_preprocessed;
 }
 
 /**
  * Segment planes that aren't relevant to the objects.
+ * The planes are removed from a shrinking set of indices into cloud_cluster,
+ * so the points are only copied once, after the last plane has been found.
+ * The hints are tested first, e.g. the planes of the previous frame, as the camera usually didn't move.
  * @param cloud_cluster
+ * @param plane_hints coefficients of planes that are likely to be found, replaced with the found planes
  */
-PointCloudRGBPtr segmentPlanes(PointCloudRGBPtr cloud_cluster) {
+PointCloudRGBNormalPtr segmentPlanes(PointCloudRGBNormalPtr cloud_cluster, std::vector<Eigen::VectorXf> &plane_hints) {
     // While a segmented plane would be larger than plane_size_threshold points, segment it.
-    bool loop_segmentations = true;
-    int segmentations_amount = 0;
-    int plane_size_threshold = 8000;
-    PointIndices plane_indices(new pcl::PointIndices);
-    int c = 0;
-    for (int n = 0; loop_segmentations; n++) {
-        plane_indices = estimatePlaneIndices(cloud_cluster);
+    size_t plane_size_threshold = 8000;
+    std::vector<Eigen::VectorXf> planes;
+    std::vector<int> remaining(cloud_cluster->points.size());
+    std::vector<int> next_remaining;
+    for (size_t i = 0; i < remaining.size(); i++) {
+        remaining[i] = static_cast<int>(i);
+    }
 
-        if (plane_indices->indices.size() > plane_size_threshold)         // is the extracted plane big enough?
-        {
+    while (remaining.size() > plane_size_threshold) {
+        Eigen::VectorXf coefficients;
+        PointIndices plane_indices = estimatePlaneIndices(cloud_cluster, remaining, plane_hints,
+                                                          plane_size_threshold, coefficients);
 
-            ROS_INFO("plane_indices: %lu", plane_indices->indices.size());
-            ROS_INFO("cloud_cluster: %lu", cloud_cluster->points.size());
-            cloud_cluster = extractCluster(cloud_cluster, plane_indices, true); // actually extract the object
+        if (plane_indices->indices.size() <= plane_size_threshold) { // is the extracted plane big enough?
+            break;                                                  // if not big enough, stop looping.
+        }
 
-            n++;
-        } else loop_segmentations = false;          // if not big enough, stop looping.
-        segmentations_amount = n;
+        ROS_INFO("plane_indices: %lu", plane_indices->indices.size());
+        ROS_INFO("cloud_cluster: %lu", remaining.size());
+
+        // Both index lists are sorted, as the plane indices are a subset of the remaining ones
+        next_remaining.clear();
+        std::set_difference(remaining.begin(), remaining.end(),
+                            plane_indices->indices.begin(), plane_indices->indices.end(),
+                            std::back_inserter(next_remaining));
+        remaining.swap(next_remaining);
+        planes.push_back(coefficients);
+    }
+    ROS_INFO("Extracted %lu planes!", planes.size());
+    plane_hints = planes;
+
+    if (planes.empty()) {
+        return cloud_cluster;
     }
-    ROS_INFO("Extracted %d planes!", segmentations_amount);
-    return cloud_cluster;
+
+    PointIndices object_indices(new pcl::PointIndices);
+    object_indices->indices.swap(remaining);
+    return extractCluster(cloud_cluster, object_indices, false); // actually extract the objects
 }
 
 /**
  * Find the objects.
  * @param kinect
+ * @param transformer long-lived transformer of the node, knows where the table is
+ * @param search_cache search trees of this frame
+ * @param plane_hints planes of the previous frame, replaced with the planes of this one
+ * @param cropped_buffer output of the crop filter, kept by the caller so its memory is reused for every frame
  * @return
  */
-std::vector<PointCloudRGBPtr> findCluster(PointCloudRGBPtr kinect) {
+std::vector<PointCloudRGBNormalPtr> findCluster(PointCloudRGBPtr kinect,
+                                                CloudTransformer &transformer,
+                                                SearchCache &search_cache,
+                                                std::vector<Eigen::VectorXf> &plane_hints,
+                                                PointCloudRGBPtr cropped_buffer) {
+    if (perception_params.organized_mode) {
+        if (kinect->isOrganized()) {
+            return findClusterOrganized(kinect, search_cache, cropped_buffer);
+        }
+        ROS_WARN("Organized mode is enabled, but the kinect cloud is not organized. Using the default pipeline.");
+    }
 
-    ros::NodeHandle n;
-    std::vector<PointCloudRGBPtr> result;
-    CloudTransformer transform_cloud(n);
-    PointCloudRGBPtr cloud_cluster(new PointCloudRGB),
-            cloud_preprocessed(new PointCloudRGB);
+    std::vector<PointCloudRGBNormalPtr> result;
+    PointCloudRGBNormalPtr cloud_cluster(new PointCloudRGBNormal),
+            cloud_preprocessed(new PointCloudRGBNormal);
     PointIndices
             plane_indices2(new pcl::PointIndices),
             prism_indices(new pcl::PointIndices);
 
     ROS_INFO("Starting Cluster extraction");
-    savePointCloudRGBNamed(kinect, "1_kinect");
+    recordStage(SNAPSHOT_KINECT, kinect, "1_kinect");
 
-    cloud_preprocessed = preprocessCloud(kinect);
-    savePointCloudRGBNamed(cloud_preprocessed, "2_cloud_preprocessed");
+    cloud_preprocessed = preprocessCloud(kinect, cropped_buffer);
+    recordStage(SNAPSHOT_PREPROCESSED, cloud_preprocessed, "2_cloud_preprocessed");
 
     // Delete everything that's not in a cluster with the table
-    std::vector<PointCloudRGBPtr> extracted_cloud_preprocessed;
-    extracted_cloud_preprocessed = euclideanClusterExtraction(cloud_preprocessed);
+    std::vector<PointCloudRGBNormalPtr> extracted_cloud_preprocessed;
+    extracted_cloud_preprocessed = euclideanClusterExtraction(cloud_preprocessed, search_cache, perception_params.core);
+    if (extracted_cloud_preprocessed.empty()) {
+        ROS_ERROR("No cluster found in the preprocessed cloud");
+        error_message = "No cluster found after preprocessing. ";
+        return result;
+    }
     cloud_preprocessed = extracted_cloud_preprocessed[0];
 
-    cloud_preprocessed = transform_cloud.extractAbovePlane(cloud_preprocessed);
-    savePointCloudRGBNamed(cloud_preprocessed, "3_extracted_above_plane");
+    cloud_preprocessed = transformer.extractAbovePlane(cloud_preprocessed);
+    recordStage(SNAPSHOT_ABOVE_PLANE, cloud_preprocessed, "3_extracted_above_plane");
 
     cloud_cluster = cloud_preprocessed;
 
-    cloud_cluster = segmentPlanes(cloud_cluster);
-    savePointCloudRGBNamed(cloud_cluster, "4_cloud_final");
+    cloud_cluster = segmentPlanes(cloud_cluster, plane_hints);
+    recordStage(SNAPSHOT_FINAL, cloud_cluster, "4_cloud_final");
 
     ROS_INFO("Points after segmentation: %lu", cloud_cluster->points.size());
-    cloud_global = cloud_cluster;
+    setDebugCloud(cloud_cluster);
 
     // Split cloud_final into one PointCloud per object
 
-    result = euclideanClusterExtraction(cloud_cluster);
+    result = euclideanClusterExtraction(cloud_cluster, search_cache, perception_params.core);
 
     ROS_INFO("CALCULATED RESULT!");
 
@@ -123,7 +176,150 @@ std::vector<PointCloudRGBPtr> findCluster(PointCloudRGBPtr kinect) {
     for (int i = 0; i < result.size(); i++) {
         std::stringstream obj_files;
         obj_files << "object_" << i;
-        savePointCloudRGBNamed(result[i], obj_files.str());
+        recordStage(SNAPSHOT_OBJECTS, result[i], obj_files.str());
+    }
+
+    return result;
+}
+
+/**
+ * Find the objects without giving up the image grid of the kinect cloud.
+ * Normals are computed from integral images and the planes are found with an organized
+ * multi plane segmentation, so no KdTree or RANSAC is needed until the objects are clustered.
+ * The objects are downsampled like in findCluster(), but skip MLS, so the CVFH features differ
+ * from the ones the shipped forests were trained with.
+ * @param kinect organized PointCloud
+ * @param search_cache search trees of this frame
+ * @param cropped_buffer output of the crop filter, kept by the caller so its memory is reused for every frame
+ * @return One PointCloud per object, like findCluster()
+ */
+std::vector<PointCloudRGBNormalPtr> findClusterOrganized(PointCloudRGBPtr kinect, SearchCache &search_cache,
+                                                         PointCloudRGBPtr cropped_buffer) {
+    std::vector<PointCloudRGBNormalPtr> result;
+    PointCloudRGBPtr cloud_cropped(new PointCloudRGB);
+    PointCloudRGBNormalPtr cloud_with_normals(new PointCloudRGBNormal),
+            cloud_objects(new PointCloudRGBNormal);
+    PointCloudNormalPtr normals(new PointCloudNormal);
+
+    ROS_INFO("Starting organized Cluster extraction");
+    recordStage(SNAPSHOT_KINECT, kinect, "1_kinect");
+
+    // Filtered points become NaN, so the cloud keeps its width and height
+    cloud_cropped = apply3DFilter(kinect, 0.4, 0.4, 1.5, true, cropped_buffer);
+    normals = estimateIntegralImageNormals(cloud_cropped);
+
+    // Find all planes in the image grid
+    std::vector<pcl::PlanarRegion<pcl::PointXYZRGB>,
+            Eigen::aligned_allocator<pcl::PlanarRegion<pcl::PointXYZRGB> > > regions;
+    std::vector<pcl::ModelCoefficients> model_coefficients;
+    std::vector<pcl::PointIndices> inlier_indices;
+    pcl::PointCloud<pcl::Label>::Ptr labels(new pcl::PointCloud<pcl::Label>);
+    std::vector<pcl::PointIndices> label_indices;
+    std::vector<pcl::PointIndices> boundary_indices;
+
+    pcl::OrganizedMultiPlaneSegmentation<pcl::PointXYZRGB, pcl::Normal, pcl::Label> mps;
+    mps.setMinInliers(5000);
+    mps.setAngularThreshold(3.0 * (M_PI / 180.0)); // 3 degrees
+    mps.setDistanceThreshold(0.02);                 // 2cm
+    mps.setInputNormals(normals);
+    mps.setInputCloud(cloud_cropped);
+    mps.segmentAndRefine(regions, model_coefficients, inlier_indices, labels, label_indices, boundary_indices);
+
+    if (inlier_indices.empty()) {
+        ROS_ERROR("No plane (indices) found");
+        error_message = "No plane found. ";
+        setDebugCloud(cloud_objects);
+        return result;
+    }
+    ROS_INFO("Found %lu planes!", inlier_indices.size());
+
+    // The biggest plane is the table
+    int table_index = 0;
+    for (int i = 1; i < inlier_indices.size(); i++) {
+        if (inlier_indices[i].indices.size() > inlier_indices[table_index].indices.size()) {
+            table_index = i;
+        }
+    }
+
+    // Convex hull of the table, using every 4th point is precise enough
+    PointCloudRGBPtr table(new PointCloudRGB),
+            table_hull(new PointCloudRGB);
+    const std::vector<int> &table_indices = inlier_indices[table_index].indices;
+    for (int i = 0; i < table_indices.size(); i += 4) {
+        table->points.push_back(cloud_cropped->points[table_indices[i]]);
+    }
+    table->width = table->points.size();
+    table->height = 1;
+    pcl::ConvexHull<pcl::PointXYZRGB> hull;
+    hull.setInputCloud(table);
+    hull.setDimension(2);
+    hull.reconstruct(*table_hull);
+
+    // Everything that is valid and not part of any plane may be an object
+    std::vector<bool> is_plane(cloud_cropped->points.size(), false);
+    for (int i = 0; i < inlier_indices.size(); i++) {
+        for (int j = 0; j < inlier_indices[i].indices.size(); j++) {
+            is_plane[inlier_indices[i].indices[j]] = true;
+        }
+    }
+    PointIndices candidate_indices(new pcl::PointIndices);
+    for (int i = 0; i < cloud_cropped->points.size(); i++) {
+        if (!is_plane[i] && pcl::isFinite(cloud_cropped->points[i])) {
+            candidate_indices->indices.push_back(i);
+        }
+    }
+
+    // Only keep the points in a prism above the table
+    PointIndices object_indices(new pcl::PointIndices);
+    pcl::ExtractPolygonalPrismData<pcl::PointXYZRGB> prism;
+    prism.setInputCloud(cloud_cropped);
+    prism.setIndices(candidate_indices);
+    prism.setInputPlanarHull(table_hull);
+    prism.setHeightLimits(0.01, 0.5);
+    prism.segment(*object_indices);
+
+    // Integral image normals are NaN at depth discontinuities, which are the outlines of the objects.
+    // CVFH can't use those points, so they are dropped before clustering.
+    PointIndices finite_indices(new pcl::PointIndices);
+    finite_indices->indices.reserve(object_indices->indices.size());
+    for (int i = 0; i < object_indices->indices.size(); i++) {
+        const pcl::Normal &normal = normals->points[object_indices->indices[i]];
+        if (pcl_isfinite(normal.normal_x) && pcl_isfinite(normal.normal_y) && pcl_isfinite(normal.normal_z)) {
+            finite_indices->indices.push_back(object_indices->indices[i]);
+        }
+    }
+
+    // Keep the integral image normals with the points, so the features don't need to estimate them again
+    pcl::concatenateFields(*cloud_cropped, *normals, *cloud_with_normals);
+    cloud_objects = extractCluster(cloud_with_normals, finite_indices, false);
+    recordStage(SNAPSHOT_FINAL, cloud_objects, "4_cloud_final");
+
+    ROS_INFO("Points after segmentation: %lu", cloud_objects->points.size());
+    setDebugCloud(cloud_objects);
+
+    // Split cloud_objects into one PointCloud per object
+    if (!cloud_objects->points.empty()) {
+        result = euclideanClusterExtraction(cloud_objects, search_cache, perception_params.core);
+    }
+
+    // The objects of findCluster() went through the voxel grid, so give these the same density for the features.
+    // They still skip MLS, see organized_mode in node_only.launch.
+    for (int i = 0; i < result.size(); i++) {
+        result[i] = voxelGridFilterWithNormals(result[i], perception_params.core.voxel_leaf_size);
+    }
+
+    if (cloud_global->points.size() == 0) {
+        ROS_ERROR("Extracted Cluster is empty");
+        error_message = "Final extracted cluster was empty. ";
+    } else {
+        ROS_INFO("%sExtraction OK", "\x1B[32m");
+        error_message = "";
+    }
+
+    for (int i = 0; i < result.size(); i++) {
+        std::stringstream obj_files;
+        obj_files << "object_" << i;
+        recordStage(SNAPSHOT_OBJECTS, result[i], obj_files.str());
     }
 
     return result;
@@ -131,19 +327,41 @@ std::vector<PointCloudRGBPtr> findCluster(PointCloudRGBPtr kinect) {
 
 /**
  * Finds the geometrical center and rotation of an object.
+ * Also updates the clouds and the pose that are published for debugging.
  * @param The pointcloud object_cloud
  * @return The pose of the object contained in object_cloud
  */
-geometry_msgs::PoseStamped findPose(const PointCloudRGBPtr input, std::string label) {
+geometry_msgs::PoseStamped findPose(const PointCloudRGBNormalPtr input, std::string label) {
+    PoseEstimate estimate;
+    if (!estimatePose(input, label, estimate)) {
+        return estimate.pose;
+    }
+
+    boost::mutex::scoped_lock lock(debug_clouds_mutex);
+    cloud_mesh = estimate.mesh;
+    cloud_aligned = estimate.aligned;
+    global_tf_rotation = estimate.rotation;
+    pose_global = estimate.pose;
+    return estimate.pose;
+}
+
+/**
+ * Finds the geometrical center and rotation of an object.
+ * Only uses its arguments and the model registry, so it can run in parallel for several objects.
+ * @param input The pointcloud object_cloud
+ * @param label classifier label of the object
+ * @param estimate returns the pose and the aligned mesh. If there is none, the error says why.
+ * @return true if the mesh could be aligned
+ */
+bool estimatePose(const PointCloudRGBNormalPtr input, const std::string &label, PoseEstimate &estimate) {
     // instantiate objects for results
 
-    geometry_msgs::PoseStamped current_pose, map_pose;
+    geometry_msgs::PoseStamped &current_pose = estimate.pose;
     tf::Quaternion quat_tf, quat_rot;
     geometry_msgs::QuaternionStamped quat_msg;
     Eigen::Vector4f centroid;
-    tf::TransformListener t_listener;
+    Eigen::Matrix4f transformation;
 
-    std::string map = "map";
     std::string kinect_frame = "head_mount_kinect_rgb_optical_frame";
 
     ROS_INFO("Starting pose estimation");
@@ -152,15 +370,34 @@ geometry_msgs::PoseStamped findPose(const PointCloudRGBPtr input, std::string la
     current_pose.header.frame_id = kinect_frame;
 
     // Calculate quaternions
-    cloud_mesh = getTargetByLabel(label, centroid);
+    const ObjectModel *model = model_registry.get(label);
+    if (model == NULL) {
+        ROS_ERROR("No mesh for the label %s", label.c_str());
+        estimate.error = "No mesh for " + label + ". ";
+        return false;
+    }
+    estimate.mesh = getTargetByLabel(label, centroid);
 
     ROS_INFO("Alignment...");
     // initial alignment
-    cloud_aligned = iterativeClosestPoint(cloud_mesh, input);
+    if (perception_params.pyramid_icp) {
+        estimate.aligned = pyramidIterativeClosestPoint(input, *model, perception_params.icp_levels,
+                                                        perception_params.icp_point_to_plane,
+                                                        perception_params.global_alignment, transformation);
+    } else {
+        PointCloudRGBPtr input_points(new PointCloudRGB);
+        pcl::copyPointCloud(*input, *input_points);
+        estimate.aligned = iterativeClosestPoint(estimate.mesh, input_points, transformation);
+    }
+    if (estimate.aligned->points.empty()) {
+        estimate.error = "Alignment of " + label + " failed. ";
+        return false;
+    }
+    estimate.rotation = rotationOf(transformation);
 
     ROS_INFO("Calculating centroid");
     // calculate and set centroid from mesh
-    pcl::compute3DCentroid(*cloud_aligned, centroid);
+    pcl::compute3DCentroid(*estimate.aligned, centroid);
     current_pose.pose.position.x = centroid.x();
     current_pose.pose.position.y = centroid.y();
     current_pose.pose.position.z = centroid.z();
@@ -168,9 +405,9 @@ geometry_msgs::PoseStamped findPose(const PointCloudRGBPtr input, std::string la
     ROS_INFO("Calculating quaternion");
 
     // calculate quaternion
-    tf::StampedTransform t_transform, map_transform, rotated_transform;
+    tf::StampedTransform t_transform;
 
-    t_transform.setBasis(global_tf_rotation);
+    t_transform.setBasis(estimate.rotation);
     quat_tf = t_transform.getRotation();
     quat_tf.normalize();
     quat_msg.quaternion.x = quat_tf.x();
@@ -179,7 +416,7 @@ geometry_msgs::PoseStamped findPose(const PointCloudRGBPtr input, std::string la
     quat_msg.quaternion.w = quat_tf.w();
 
 
-    if (global_tf_rotation.getRow(2).z() > 0.0) {
+    if (estimate.rotation.getRow(2).z() > 0.0) {
         ROS_INFO("Wrong rotation! Flipping quaternion");
 
         quat_rot.setX(0.0);
@@ -198,120 +435,95 @@ geometry_msgs::PoseStamped findPose(const PointCloudRGBPtr input, std::string la
     ROS_INFO("Quaternion ready ");
     current_pose.pose.orientation = quat_msg.quaternion;
 
-    pose_global = current_pose;
-
     ROS_INFO("POSE ESTIMATION DONE");
-    return current_pose;
+    return true;
 }
 
-/**
- * Estimates surface normals.
- * @param Pointcloud input
- * @return The estimated surface normals of the input Pointcloud
- */
-PointCloudNormalPtr estimateSurfaceNormals(PointCloudRGBPtr input) {
-    ROS_INFO("ESTIMATING SURFACE NORMALS");
-
-
-    pcl::NormalEstimation<pcl::PointXYZRGB, pcl::Normal> ne;
-    ne.setInputCloud(input);
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree(
-            new pcl::search::KdTree<pcl::PointXYZRGB>());
-    ne.setSearchMethod(tree);
-
-    PointCloudNormalPtr cloud_normals(new PointCloudNormal);
-
-    ne.setRadiusSearch(0.03); // Use all neighbors in a sphere of radius 3cm
-
-    ne.compute(*cloud_normals);
-
-    ROS_INFO("SURFACE NORMALS ESTIMATED SUCCESSFULLY!");
-    return cloud_normals;
-}
 
 /**
- * Applies a PassThrough filter to all dimensions, reducing points and
+ * Crops the input to a box in front of the kinect, reducing points and
  * narrowing field of vision.
  * @param input Pointcloud
- * @param x
- * @param y
- * @param z
+ * @param x half width of the box
+ * @param y half height of the box
+ * @param z depth of the box
+ * @param keep_organized if true, filtered points are set to NaN instead of being removed
+ * @param output optional PointCloud to reuse for the result
  * @return Filtered Pointcloud
  */
 PointCloudRGBPtr apply3DFilter(PointCloudRGBPtr input,
                                float x,
                                float y,
-                               float z) {
-
-
-    ROS_INFO("Starting passthrough filter");
-    PointCloudRGBPtr input_after_x(new PointCloudRGB),
-            input_after_xy(new PointCloudRGB), input_after_xyz(new PointCloudRGB);
-    /** Create the filtering object **/
-    // Create the filtering object (x-axis)
-    pcl::PassThrough<pcl::PointXYZRGB> pass;
-    pass.setInputCloud(input);
-    pass.setFilterFieldName("x");
-    pass.setFilterLimits(-x, x);
-
-    //pass.setUserFilterValue(0.0f);
-    pass.setKeepOrganized(false);
-    pass.filter(*input_after_x);
-
-    // Create the filtering object (y-axis)
-    pass.setInputCloud(input_after_x);
-    pass.setFilterFieldName("y");
-    pass.setFilterLimits(-y, y);
-
-    //pass.setUserFilterValue(0.0f);
-    pass.setKeepOrganized(false);
-    pass.filter(*input_after_xy);
-
-    // Create the filtering object (z-axis)
-    pass.setInputCloud(input_after_xy);
-    pass.setFilterFieldName("z");
-    pass.setFilterLimits(
-            0.0, z); // no negative range (the pr2 can't look behind its head)
-
-    //pass.setUserFilterValue(0.0f);
-    pass.setKeepOrganized(true);
-    pass.filter(*input_after_xyz);
-
-    if (input_after_xyz->points.size() == 0) {
-        ROS_ERROR("Cloud empty after passthrough filtering");
-        error_message = "Cloud was empty after filtering. ";
+                               float z,
+                               bool keep_organized,
+                               PointCloudRGBPtr output) {
+    ROS_INFO("Starting crop filter");
+    if (!output) {
+        output.reset(new PointCloudRGB);
     }
 
+    // no negative z range (the pr2 can't look behind its head)
+    size_t inside = cropBoxFilter(*input,
+                                  Eigen::Vector3f(-x, -y, 0.0f),
+                                  Eigen::Vector3f(x, y, z),
+                                  keep_organized,
+                                  *output);
+
+    if (inside == 0) {
+        ROS_ERROR("Cloud empty after crop filtering");
+        error_message = "Cloud was empty after filtering. ";
+    }
 
-    return input_after_xyz;
+    return output;
 }
 
 /**
- * Estimates plane indices of a PointCloud.
+ * Estimates the largest plane among some points of a PointCloud.
+ * Each hint is tested first and the first one with at least min_inliers inliers
+ * is refitted instead of running RANSAC.
  * @param input PointCloud
+ * @param indices sorted indices of the points to search, the plane indices are a subset of them
+ * @param hints plane coefficients (a, b, c, d) that are likely to match
+ * @param min_inliers inliers a hint needs to be accepted
+ * @param coefficients returns the coefficients of the found plane
  * @return Indices of the plane points in the PointCloud.
  */
-PointIndices estimatePlaneIndices(PointCloudRGBPtr input) {
+PointIndices estimatePlaneIndices(PointCloudRGBNormalPtr input,
+                                  const std::vector<int> &indices,
+                                  const std::vector<Eigen::VectorXf> &hints,
+                                  size_t min_inliers,
+                                  Eigen::VectorXf &coefficients) {
+    const double distance_threshold = 0.01; // Distance to model points
+    PointIndices plane_indices(new pcl::PointIndices);
+    pcl::SampleConsensusModelPlane<pcl::PointXYZRGBNormal>::Ptr model(
+            new pcl::SampleConsensusModelPlane<pcl::PointXYZRGBNormal>(input, indices));
+
+    for (size_t i = 0; i < hints.size(); i++) {
+        model->selectWithinDistance(hints[i], distance_threshold, plane_indices->indices);
+        if (plane_indices->indices.size() >= min_inliers) {
+            ROS_INFO("Plane found with the coefficients of the last frame");
+            model->optimizeModelCoefficients(plane_indices->indices, hints[i], coefficients);
+            model->selectWithinDistance(coefficients, distance_threshold, plane_indices->indices);
+            return plane_indices;
+        }
+    }
 
     ROS_INFO("Starting plane indices estimation");
-    PointIndices planeIndices(new pcl::PointIndices);
-    pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
-    pcl::SACSegmentation<pcl::PointXYZRGB> segmentation;
-
-    segmentation.setInputCloud(input);
-    segmentation.setModelType(pcl::SACMODEL_PLANE);
-    segmentation.setMethodType(pcl::SAC_RANSAC);
-    segmentation.setDistanceThreshold(0.01); // Distance to model points
-    segmentation.setOptimizeCoefficients(true);
-    segmentation.segment(*planeIndices, *coefficients);
-
-
-    if (planeIndices->indices.size() == 0) {
+    pcl::RandomSampleConsensus<pcl::PointXYZRGBNormal> ransac(model, distance_threshold);
+    if (!ransac.computeModel()) {
         ROS_ERROR("No plane (indices) found");
         error_message = "No plane found. ";
+        plane_indices->indices.clear();
+        return plane_indices;
     }
 
-    return planeIndices;
+    Eigen::VectorXf ransac_coefficients;
+    ransac.getModelCoefficients(ransac_coefficients);
+    ransac.getInliers(plane_indices->indices);
+    model->optimizeModelCoefficients(plane_indices->indices, ransac_coefficients, coefficients);
+    model->selectWithinDistance(coefficients, distance_threshold, plane_indices->indices);
+
+    return plane_indices;
 }
 
 /**
@@ -322,14 +534,12 @@ PointIndices estimatePlaneIndices(PointCloudRGBPtr input) {
  * or all points not fulfilling the indices.
  * @return Extracted PointCloud
  */
-PointCloudRGBPtr extractCluster(PointCloudRGBPtr input,
-                                PointIndices indices,
-                                bool negative) {
+PointCloudRGBNormalPtr extractCluster(PointCloudRGBNormalPtr input,
+                                      PointIndices indices,
+                                      bool negative) {
     ROS_INFO("CLUSTER EXTRACTION");
-    PointCloudRGBPtr result(new PointCloudRGB);
-
-    PointCloudRGBPtr objects(new PointCloudRGB);
-    pcl::ExtractIndices<pcl::PointXYZRGB> extract;
+    PointCloudRGBNormalPtr objects(new PointCloudRGBNormal);
+    pcl::ExtractIndices<pcl::PointXYZRGBNormal> extract;
     extract.setInputCloud(input);
     extract.setIndices(indices);
     extract.setNegative(negative);
@@ -340,152 +550,16 @@ PointCloudRGBPtr extractCluster(PointCloudRGBPtr input,
     return objects;
 }
 
-/**
- * Filters the input cloud with a moving least squares algorithm.
- * @param PointCloud input
- * @return The filtered PointCloud
- */
-PointCloudRGBPtr mlsFilter(PointCloudRGBPtr input) {
-    ROS_INFO("MLS Filter!");
-    PointCloudRGBPtr result(new PointCloudRGB);
-
-    int poly_ord = 1;
-
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZRGB>);
-    pcl::PointCloud<pcl::PointNormal> mls_points;
-    pcl::MovingLeastSquares<pcl::PointXYZRGB, pcl::PointNormal> mls;
-
-    mls.setComputeNormals(true);
-    mls.setInputCloud(input);
-    mls.setPolynomialOrder(poly_ord); // the lower the smoother, the higher the more exact
-    mls.setSearchMethod(tree);
-    mls.setSearchRadius(0.03);
-    mls.process(mls_points);
-
-    for (int i = 0; i < mls_points.size(); i++) {
-        pcl::PointXYZRGB point;
-
-        point.x = mls_points.points[i].x;
-        point.y = mls_points.points[i].y;
-        point.z = mls_points.points[i].z;
-        point.r = input->points[i].r;
-        point.g = input->points[i].g;
-        point.b = input->points[i].b;
-        point.rgb = input->points[i].rgb;
-        point.rgba = input->points[i].rgba;
-        result->push_back(point);
-    }
-    ROS_INFO("size: %d", result->size());
-    ROS_INFO("Finished MLS Filter!");
-    return result;
-}
-
-
-/**
- * Filters the input cloud with a voxel grid filter.
- * @param PointCloud input
- * @return Filtered PointCloud
- */
-PointCloudRGBPtr voxelGridFilter(PointCloudRGBPtr input) {
-    PointCloudRGBPtr result(new PointCloudRGB);
-
-    pcl::VoxelGrid<pcl::PointXYZRGB> sor;
-    sor.setInputCloud(input);
-    sor.setLeafSize(0.005f, 0.005f, 0.005f);
-    sor.filter(*result);
-    ROS_INFO("size: %d", result->size());
-    return result;
-}
-
-/**
- * Estimates features of an object in a PointCloud using VFHSignature308.
- * @param input PointCloud
- * @return VFHSignature308 Features
- */
-PointCloudVFHS308Ptr cvfhRecognition(PointCloudRGBPtr input) {
-    ROS_INFO("CVFH Recognition!");
-    // Object for storing the normals.
-    pcl::PointCloud<pcl::Normal>::Ptr normals(new pcl::PointCloud<pcl::Normal>);
-    // Object for storing the CVFH descriptors.
-    PointCloudVFHS308Ptr descriptors(new pcl::PointCloud<pcl::VFHSignature308>);
-
-    // Estimate the normals of the object.
-    normals = estimateSurfaceNormals(input);
-
-    // New KdTree to search with.
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr kdtree(new pcl::search::KdTree<pcl::PointXYZRGB>);
-
-    // CVFH estimation object.
-    pcl::CVFHEstimation<pcl::PointXYZRGB, pcl::Normal, pcl::VFHSignature308> cvfh;
-    cvfh.setInputCloud(input);
-    cvfh.setInputNormals(normals);
-    cvfh.setSearchMethod(kdtree);
-    cvfh.setEPSAngleThreshold(5.0 / 180.0 * M_PI); // 5 degrees.
-    cvfh.setCurvatureThreshold(1.0);
-    cvfh.setNormalizeBins(false);
-    ROS_INFO("CVFH recognition parameters set. Computing now...");
-    cvfh.compute(*descriptors);
-    ROS_INFO("CVFH features computed successfully!");
-
-    return descriptors; // to vector
-}
-
-/**
- * Seperates clusters from each other using euclidean cluster extraction.
- * @param input PointCloud
- * @return Seperated PointClouds
- */
-std::vector<PointCloudRGBPtr> euclideanClusterExtraction(PointCloudRGBPtr input) {
-    ROS_INFO("Euclidean Cluster Extraction!");
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZRGB>);
-    tree->setInputCloud(input);
-
-    PointIndicesVector cluster_indices;
-    pcl::EuclideanClusterExtraction<pcl::PointXYZRGB> ec;
-    ec.setClusterTolerance(0.01);
-    ec.setMinClusterSize(100);
-    ec.setMaxClusterSize(100000);
-    ec.setSearchMethod(tree);
-    ec.setInputCloud(input);
-    ROS_INFO("BEFORE EXTRACT");
-    ec.extract(cluster_indices);
-
-
-    ROS_INFO("AFTER EXTRACT");
-
-    std::vector<PointCloudRGBPtr> result;
-
-    int j = 0;
-    for (std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin();
-         it != cluster_indices.end(); ++it) {
-        PointCloudRGBPtr cloud_cluster(new PointCloudRGB);
-        for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); ++pit)
-            cloud_cluster->points.push_back(input->points[*pit]);
-        cloud_cluster->width = cloud_cluster->points.size();
-        cloud_cluster->height = 1;
-        cloud_cluster->is_dense = true;
-
-        std::cout << "PointCloud representing the Cluster: " << cloud_cluster->points.size() << " data points."
-                  << std::endl;
-        j++;
-
-        result.push_back(cloud_cluster);
-    }
-
-
-    ROS_INFO("Finished Euclidean Cluster Extraction!");
-    return result;
-}
-
-
 /**
  * Calculates the alignment of an object to a certain target using iterative closest point algorithm.
  * @param input PointCloud
  * @param target PointCloud
+ * @param transformation returns the transformation from input to target
  * @return output PointCloud
  */
 PointCloudRGBPtr iterativeClosestPoint(PointCloudRGBPtr input,
-                                       PointCloudRGBPtr target) {
+                                       PointCloudRGBPtr target,
+                                       Eigen::Matrix4f &transformation) {
 
     PointCloudRGBPtr result(new PointCloudRGB), input_centroid(new PointCloudRGB);
 
@@ -498,219 +572,249 @@ PointCloudRGBPtr iterativeClosestPoint(PointCloudRGBPtr input,
 
     PointCloudRGBPtr final(new PointCloudRGB);
     icp.align(*final);
-    std::cout << "has converged:" << icp.hasConverged() << " score: " <<
-              icp.getFitnessScore() << std::endl;
-    std::cout << icp.getFinalTransformation() << std::endl;
-    Eigen::Matrix4f transformation = icp.getFinalTransformation();
-    tf::Matrix3x3 tf_rotation(transformation(0, 0),
-                              transformation(0, 1),
-                              transformation(0, 2),
-                              transformation(1, 0),
-                              transformation(1, 1),
-                              transformation(1, 2),
-                              transformation(2, 0),
-                              transformation(2, 1),
-                              transformation(2, 2));
-
-
-    global_tf_rotation = tf_rotation;
-
+    ROS_INFO("ICP has converged: %d, score: %f", icp.hasConverged(), icp.getFitnessScore());
+    transformation = icp.getFinalTransformation();
 
     return final;
 }
 
 /**
- * Gets the color histogram from a PointCloud.
- * @param Input PointCloud cloud
- * @return Concatenated floats (r,g,b) from PointCloud points
+ * Counts the iterations of an ICP. Registered as its visualization callback, which is called once per iteration.
  */
-std::vector<uint64_t> produceColorHist(PointCloudRGBPtr cloud) {
-    int red[8];
-    int green[8];
-    int blue[8];
-    std::vector<uint64_t> result;
+static void countIcpIteration(int *iterations,
+                              const PointCloudRGBNormal &source, const std::vector<int> &source_indices,
+                              const PointCloudRGBNormal &target, const std::vector<int> &target_indices) {
+    (*iterations)++;
+}
 
-    // initialize all array-values with 0
-    for (int i = 0; i < 8; i++) {
-        red[i] = 0;
-        green[i] = 0;
-        blue[i] = 0;
+/**
+ * Aligns the mesh of an object to the perceived object, coarse to fine. Every level runs an ICP
+ * from a downsampled copy of the perceived object to the mesh of the same level, starting from the
+ * result of the previous level, so the fine levels only need a few iterations. The first level
+ * starts from the global alignment or with the centroids on top of each other.
+ * The perceived object is moved onto the mesh, so the prebuilt KdTrees of the mesh can be used,
+ * and the inverse of the result is applied to the mesh.
+ * @param input perceived object
+ * @param model mesh from the model registry, prepared with the leaf sizes of levels
+ * @param levels from coarse to fine
+ * @param point_to_plane uses the normals of the mesh to minimize point to plane distances
+ * @param global_alignment start from globalAlignment(). The centroids are used if it fails.
+ * @param mesh_transformation returns the transformation from the mesh to the perceived object
+ * @return The aligned mesh, empty if the alignment failed or the finest level didn't converge
+ */
+PointCloudRGBPtr pyramidIterativeClosestPoint(PointCloudRGBNormalPtr input,
+                                              const ObjectModel &model,
+                                              const std::vector<IcpLevel> &levels,
+                                              bool point_to_plane,
+                                              bool global_alignment,
+                                              Eigen::Matrix4f &mesh_transformation) {
+    PointCloudRGBPtr result(new PointCloudRGB);
+    if (input->points.empty()) {
+        ROS_ERROR("Can't align an empty PointCloud");
+        return result;
+    }
+    if (model.levels.size() != levels.size()) {
+        ROS_ERROR("The mesh %s has %lu levels, ICP needs %lu", model.file.c_str(), model.levels.size(), levels.size());
+        return result;
     }
 
-    for (int i = 0; i < cloud->size(); i++) {
-        pcl::PointXYZRGB p = cloud->points[i];
-        // increase value in bin at given index
-        if (p.r < 32) {
-            red[0]++;
-
-        } else if (p.r >= 32 && p.r < 64) {
-            red[1]++;
-
-        } else if (p.r >= 64 && p.r < 96) {
-            red[2]++;
-        } else if (p.r >= 96 && p.r < 128) {
-            red[3]++;
-
-        } else if (p.r >= 128 && p.r < 160) {
-            red[4]++;
-
-        } else if (p.r >= 160 && p.r < 192) {
-            red[5]++;
-
-        } else if (p.r >= 192 && p.r < 224) {
-            red[6]++;
-
-        } else if (p.r >= 224 && p.r < 256) {
-            red[7]++;
-
-        }
-
-        if (p.g < 32) {
-            green[0]++;
-
-        } else if (p.g >= 32 && p.g < 64) {
-            green[1]++;
-
-        } else if (p.g >= 64 && p.g < 96) {
-            green[2]++;
-        } else if (p.g >= 96 && p.g < 128) {
-            green[3]++;
-
-        } else if (p.g >= 128 && p.g < 160) {
-            green[4]++;
-
-        } else if (p.g >= 160 && p.g < 192) {
-            green[5]++;
-
-        } else if (p.g >= 192 && p.g < 224) {
-            green[6]++;
-
-        } else if (p.g >= 224 && p.g < 256) {
-            green[7]++;
+    typedef pcl::IterativeClosestPoint<pcl::PointXYZRGBNormal, pcl::PointXYZRGBNormal> Icp;
+    boost::shared_ptr<Icp> icp;
+    if (point_to_plane) {
+        icp.reset(new pcl::IterativeClosestPointWithNormals<pcl::PointXYZRGBNormal, pcl::PointXYZRGBNormal>);
+    } else {
+        icp.reset(new Icp);
+    }
+    int iterations = 0;
+    boost::function<void(const PointCloudRGBNormal &, const std::vector<int> &,
+                         const PointCloudRGBNormal &, const std::vector<int> &)> iteration_counter =
+            boost::bind(&countIcpIteration, &iterations, _1, _2, _3, _4);
+    icp->registerVisualizationCallback(iteration_counter);
+    icp->setTransformationEpsilon(1e-8);
+    icp->setEuclideanFitnessEpsilon(1e-6);
+
+    Eigen::Matrix4f transformation = Eigen::Matrix4f::Identity();
+    if (!global_alignment || !globalAlignment(input, model, transformation)) {
+        // Start with the centroids on top of each other
+        Eigen::Vector4f input_centroid, model_centroid;
+        pcl::compute3DCentroid(*input, input_centroid);
+        pcl::compute3DCentroid(*model.cloud, model_centroid);
+        transformation = Eigen::Matrix4f::Identity();
+        transformation.block<3, 1>(0, 3) = (model_centroid - input_centroid).head<3>();
+    }
 
+    PointCloudRGBNormal aligned;
+    double fitness = std::numeric_limits<double>::max();
+    bool converged = false;
+    for (size_t level = 0; level < levels.size(); level++) {
+        pcl::StopWatch watch;
+        PointCloudRGBNormalPtr level_input = voxelGridFilterWithNormals(input, levels[level].leaf_size);
+
+        iterations = 0;
+        icp->setInputSource(level_input);
+        icp->setInputTarget(model.levels[level]);
+        icp->setSearchMethodTarget(model.trees[level], true); // prebuilt, don't build it again
+        icp->setMaxCorrespondenceDistance(levels[level].max_correspondence_distance);
+        icp->setMaximumIterations(levels[level].max_iterations);
+        icp->align(aligned, transformation);
+
+        converged = icp->hasConverged();
+        if (converged) {
+            transformation = icp->getFinalTransformation();
+            fitness = icp->getFitnessScore(levels[level].max_correspondence_distance);
         }
+        ROS_INFO("ICP level %lu: %lu/%lu points, %d iterations, converged: %d, fitness: %f, %.1fms",
+                 level, level_input->points.size(), model.levels[level]->points.size(), iterations,
+                 converged, fitness, watch.getTime());
+    }
 
-        if (p.b < 32) {
-            blue[0]++;
-
-        } else if (p.b >= 32 && p.b < 64) {
-            blue[1]++;
-
-        } else if (p.b >= 64 && p.b < 96) {
-            blue[2]++;
-        } else if (p.b >= 96 && p.b < 128) {
-            blue[3]++;
+    // Without a converged finest level the pose would only be the starting guess
+    if (!converged) {
+        ROS_ERROR("ICP of the mesh %s didn't converge on the finest level", model.file.c_str());
+        return result;
+    }
 
-        } else if (p.b >= 128 && p.b < 160) {
-            blue[4]++;
+    // Move the mesh onto the perceived object
+    mesh_transformation = transformation.inverse();
+    pcl::transformPointCloud(*model.cloud, aligned, mesh_transformation);
+    pcl::copyPointCloud(aligned, *result);
 
-        } else if (p.b >= 160 && p.b < 192) {
-            blue[5]++;
+    return result;
+}
 
-        } else if (p.b >= 192 && p.b < 224) {
-            blue[6]++;
+/**
+ * Finds a rough alignment of a perceived object and a mesh, no matter how they are placed,
+ * by matching their FPFH features. The features of the mesh have been computed by the model registry,
+ * if it was loaded with compute_features.
+ * @param input perceived object
+ * @param model mesh from the model registry
+ * @param transformation returns the transformation from the perceived object to the mesh
+ * @return false if no alignment has been found
+ */
+bool globalAlignment(PointCloudRGBNormalPtr input,
+                     const ObjectModel &model,
+                     Eigen::Matrix4f &transformation) {
+    if (!model.features) {
+        ROS_ERROR("The mesh %s has no features, the model registry was loaded without them", model.file.c_str());
+        return false;
+    }
+    pcl::StopWatch watch;
+    const float leaf_size = perception_params.feature_leaf_size;
+    PointCloudRGBNormalPtr input_downsampled = voxelGridFilterWithNormals(input, leaf_size);
+    PointCloudFPFHPtr input_features = computeFPFHFeatures(input_downsampled, perception_params.feature_radius);
+
+    // The mesh is the source, so only the features of the perceived object have to be put into a KdTree
+    pcl::SampleConsensusPrerejective<pcl::PointXYZRGBNormal, pcl::PointXYZRGBNormal, pcl::FPFHSignature33> align;
+    align.setInputSource(model.feature_cloud);
+    align.setSourceFeatures(model.features);
+    align.setInputTarget(input_downsampled);
+    align.setTargetFeatures(input_features);
+    align.setMaximumIterations(5000);              // bounds the time of the alignment
+    align.setNumberOfSamples(3);                   // points to sample for generating a pose
+    align.setCorrespondenceRandomness(5);          // nearest features to choose from
+    align.setSimilarityThreshold(0.9f);            // edge length similarity of the sampled polygons
+    align.setMaxCorrespondenceDistance(2.5f * leaf_size);
+    align.setInlierFraction(0.25f);                // points of the mesh that have to be matched
+
+    PointCloudRGBNormal aligned;
+    align.align(aligned);
+    ROS_INFO("Global alignment: converged: %d, %lu inliers, %.1fms", align.hasConverged(),
+             align.getInliers().size(), watch.getTime());
+    if (!align.hasConverged()) {
+        return false;
+    }
 
-        } else if (p.b >= 224 && p.b < 256) {
-            blue[7]++;
+    transformation = align.getFinalTransformation().inverse();
+    return true;
+}
 
-        }
+/**
+ * Gets the CVFH features of one object.
+ * @param cluster PointCloud of the object
+ * @param search_cache of the frame the object was found in
+ * @param features to be filled with CVFH_FEATURES_PER_OBJECT floats, e.g. one row of a feature matrix.
+ * Filled with zeros if CVFH found no descriptor.
+ */
+void getCVFHFeatures(PointCloudRGBNormalPtr cluster, SearchCache &search_cache, float *features) {
+    PointCloudVFHS308Ptr vfhs = cvfhRecognition(cluster, search_cache, perception_params.core);
+    if (vfhs->points.empty()) {
+        ROS_WARN("No CVFH descriptor for an object with %lu points", cluster->points.size());
+        std::fill(features, features + CVFH_FEATURES_PER_OBJECT, 0.0f);
+        return;
     }
+    std::copy(vfhs->points[0].histogram, vfhs->points[0].histogram + CVFH_FEATURES_PER_OBJECT, features);
+}
 
-    // concatenate red, green and blue entries
-    for (int r = 0; r < 8; r++) {
-        result.push_back(red[r]);
-    }
-    for (int g = 0; g < 8; g++) {
-        result.push_back(green[g]);
-    }
-    for (int b = 0; b < 8; b++) {
-        result.push_back(blue[b]);
+/**
+ * Gets the color features of one object. The histogram is counted on the stack
+ * and converted into the row, so nothing is allocated.
+ * @param cluster PointCloud of the object
+ * @param features to be filled with COLOR_FEATURES_PER_OBJECT floats, e.g. one row of a feature matrix.
+ * Filled with zeros if the configured histogram doesn't have COLOR_FEATURES_PER_OBJECT bins.
+ */
+void getColorFeatures(PointCloudRGBNormalPtr cluster, float *features) {
+    const ColorHistogramConfig &config = perception_params.core.color_histogram;
+    if (config.size() != COLOR_FEATURES_PER_OBJECT) {
+        ROS_ERROR("The color histogram has %d bins, the classifier needs %d", config.size(), COLOR_FEATURES_PER_OBJECT);
+        std::fill(features, features + COLOR_FEATURES_PER_OBJECT, 0.0f);
+        return;
     }
 
-    return result;
-
+    uint64_t histogram[COLOR_FEATURES_PER_OBJECT] = {0};
+    if (!cluster->points.empty()) {
+        computeColorHistogram(reinterpret_cast<const uint8_t *>(&cluster->points[0].rgba),
+                              sizeof(pcl::PointXYZRGBNormal), cluster->points.size(), config, histogram);
+    }
+    std::copy(histogram, histogram + COLOR_FEATURES_PER_OBJECT, features);
 }
 
+/**
+ * Gets all features of one object. Safe to call for several objects at the same time.
+ * @param cluster PointCloud of the object
+ * @param search_cache of the frame the object was found in
+ * @param cvfh_features to be filled with CVFH_FEATURES_PER_OBJECT floats
+ * @param color_features to be filled with COLOR_FEATURES_PER_OBJECT floats
+ */
+void getObjectFeatures(PointCloudRGBNormalPtr cluster, SearchCache *search_cache,
+                       float *cvfh_features, float *color_features) {
+    getCVFHFeatures(cluster, *search_cache, cvfh_features);
+    getColorFeatures(cluster, color_features);
+}
 
 /**
  * Gets the CVFH features from PointClouds.
  * @param all_clusters PointCloud
- * @return CVFH features, a histogram of angles between a central viewpoint direction and each normal
+ * @param search_cache of the frame the objects were found in
+ * @param features row major matrix with one row of CVFH_FEATURES_PER_OBJECT floats per cluster, to be filled
  */
-std::vector<float> getCVFHFeatures(std::vector<PointCloudRGBPtr> all_clusters) {
-
-    PointCloudVFHS308Ptr vfhs(new pcl::PointCloud<pcl::VFHSignature308>);
-    std::vector<float> result;
-
-
+void getCVFHFeatures(std::vector<PointCloudRGBNormalPtr> all_clusters, SearchCache &search_cache, float *features) {
     for (int i = 0; i < all_clusters.size(); i++) {
-
-        vfhs = cvfhRecognition(all_clusters[i]);
-
-        for (int x = 0; x < 308; x++) {
-            //ROS_INFO("%f", current_features[x]);
-            result.push_back(vfhs->points[0].histogram[x]);
-        }
+        getCVFHFeatures(all_clusters[i], search_cache, features + i * CVFH_FEATURES_PER_OBJECT);
     }
-
-    return result;
 }
 
 
 /**
- * Gets the color features from a PointCloud.
+ * Gets the color features from PointClouds.
  * @param all_clusters PointCloud
- * @param color_features_vector to be filled
+ * @param features row major matrix with one row of COLOR_FEATURES_PER_OBJECT floats per cluster, to be filled
  */
-std::vector<uint64_t> getColorFeatures(std::vector<PointCloudRGBPtr> all_clusters) {
-
-    std::vector<uint64_t> current_color_features;
-    std::vector<uint64_t> result;
-
+void getColorFeatures(std::vector<PointCloudRGBNormalPtr> all_clusters, float *features) {
     for (int i = 0; i < all_clusters.size(); i++) {
-        current_color_features = produceColorHist(all_clusters[i]);
-
-        for (int x = 0; x < 24; x++) {
-            //ROS_INFO("%f", current_color_features[x]);
-            result.push_back(current_color_features[x]);
-        }
+        getColorFeatures(all_clusters[i], features + i * COLOR_FEATURES_PER_OBJECT);
     }
-
-    return result;
 }
 
 /**
- * Load the correct PCD file for the label given.
+ * Get the mesh of the label given from the model registry.
  * @param label
- * @return Object PointCloud out of PCD file
+ * @return Object PointCloud of the mesh, empty if the label has no mesh
  */
 PointCloudRGBPtr getTargetByLabel(std::string label, Eigen::Vector4f centroid) {
-    PointCloudRGBPtr result(new PointCloudRGB),
-            mesh(new PointCloudRGB);
-
-    if (label == "PringlesPaprika") {
-        pcl::io::loadPCDFile("../../../src/vision_suturo_1718/vision/meshes/pringles.pcd", *mesh);
-
-    } else if (label == "PringlesSalt") {
-        pcl::io::loadPCDFile("../../../src/vision_suturo_1718/vision/meshes/pringles.pcd", *mesh);
-    } else if (label == "SiggBottle") {
-        pcl::io::loadPCDFile("../../../src/vision_suturo_1718/vision/meshes/sigg_bottle.pcd", *mesh);
-    } else if (label == "JaMilch") {
-        pcl::io::loadPCDFile("../../../src/vision_suturo_1718/vision/meshes/ja_milch.pcd", *mesh);
-    } else if (label == "TomatoSauceOroDiParma") {
-        pcl::io::loadPCDFile("../../../src/vision_suturo_1718/vision/meshes/tomato_sauce_oro_di_parma.pcd", *mesh);
-    } else if (label == "KoellnMuesliKnusperHonigNuss") {
-        pcl::io::loadPCDFile("../../../src/vision_suturo_1718/vision/meshes/koelln_muesli_knusper_honig_nuss.pcd",
-                             *mesh);
-    } else if (label == "KelloggsToppasMini") {
-        pcl::io::loadPCDFile("../../../src/vision_suturo_1718/vision/meshes/kelloggs_toppas_mini.pcd", *mesh);
-    } else if (label == "HelaCurryKetchup") {
-        pcl::io::loadPCDFile("../../../src/vision_suturo_1718/vision/meshes/hela_curry_ketchup.pcd", *mesh);
-    } else if (label == "CupEcoOrange") {
-        pcl::io::loadPCDFile("../../../src/vision_suturo_1718/vision/meshes/cup_eco_orange.pcd", *mesh);
-    } else if (label == "EdekaRedBowl") {
-        pcl::io::loadPCDFile("../../../src/vision_suturo_1718/vision/meshes/edeka_red_bowl.pcd", *mesh);
+    PointCloudRGBPtr mesh(new PointCloudRGB);
+    const ObjectModel *model = model_registry.get(label);
+    if (model != NULL) {
+        pcl::copyPointCloud(*model->cloud, *mesh);
     }
-
     return mesh;
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include <pcl_conversions/pcl_conversions.h>
 #include <pcl/common/time.h>
 #include <pcl/features/cvfh.h>
+#include <pcl/features/fpfh.h>
+#include <pcl/features/integral_image_normal.h>
 #include <pcl/features/normal_3d.h>
 #include <pcl/filters/extract_indices.h>
 #include <pcl/filters/passthrough.h>
@@ -19,52 +21,167 @@
 #include <pcl/registration/icp.h>
 #include <pcl/registration/ia_ransac.h>
 #include <pcl/registration/sample_consensus_prerejective.h>
+#include <pcl/sample_consensus/ransac.h>
+#include <pcl/sample_consensus/sac_model_plane.h>
 #include <pcl/search/kdtree.h>
 #include <pcl/segmentation/extract_clusters.h>
+#include <pcl/segmentation/extract_polygonal_prism_data.h>
+#include <pcl/segmentation/organized_multi_plane_segmentation.h>
 #include <pcl/segmentation/sac_segmentation.h>
 #include <pcl/surface/convex_hull.h>
 #include <pcl/surface/mls.h>
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <tf/LinearMath/Matrix3x3.h>
 
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include <pcl/common/io.h>
 
 #include "short_types.h"
+#include "perception_core.h"
+#include "model_registry.h"
 #include "transformer/CloudTransformer.h"
 #include "../saving/saving.h"
+#include "../saving/flight_recorder.h"
 
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
 #include <iterator>
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <string>
 
+typedef geometry_msgs::PointStamped PointStamped;
+typedef sensor_msgs::PointCloud2 SMSGSPointCloud2;
+
+const int CVFH_FEATURES_PER_OBJECT = 308;  // bins of a VFHSignature308
+const int COLOR_FEATURES_PER_OBJECT = 24;  // 8 bins for each of r, g and b
+
+/**
+ * One level of the ICP pyramid, from coarse to fine.
+ */
+struct IcpLevel {
+    float leaf_size;                   // voxel size both clouds are downsampled to, 0 keeps all points
+    float max_correspondence_distance; // points further apart than this aren't matched
+    int max_iterations;                // the level stops earlier once it has converged
+
+    IcpLevel(float leaf, float distance, int iterations)
+            : leaf_size(leaf), max_correspondence_distance(distance), max_iterations(iterations) {}
+};
+
+/**
+ * Parameters of the perception pipeline. Set once when the node starts.
+ */
+struct PerceptionParams {
+    bool organized_mode;       // Keep the kinect image grid and use organized normals/plane segmentation
+    bool pyramid_icp;          // Align the meshes coarse to fine instead of with one full resolution ICP
+    bool icp_point_to_plane;   // Minimize point to plane instead of point to point distances (pyramid only)
+    bool global_alignment;     // Start the pyramid ICP from an FPFH based alignment instead of the centroids
+    std::vector<IcpLevel> icp_levels;
+    float feature_leaf_size;   // voxel size of the clouds the FPFH features are computed on
+    float feature_radius;
+    PerceptionCoreParams core; // filters and features, shared with the batch_processor
+
+    PerceptionParams() : organized_mode(false), pyramid_icp(false), icp_point_to_plane(false),
+                         global_alignment(false), feature_leaf_size(0.01f), feature_radius(0.025f) {
+        icp_levels.push_back(IcpLevel(0.02f, 0.15f, 50));
+        icp_levels.push_back(IcpLevel(0.01f, 0.05f, 30));
+        icp_levels.push_back(IcpLevel(0.0f, 0.02f, 20));
+    }
 
-std::vector<PointCloudRGBPtr>           findCluster(const PointCloudRGBPtr kinect);
+    ModelRegistryConfig modelRegistryConfig() const {
+        ModelRegistryConfig config;
+        for (size_t i = 0; i < icp_levels.size(); i++) {
+            config.leaf_sizes.push_back(icp_levels[i].leaf_size);
+        }
+        config.normal_radius = core.normal_radius;
+        config.compute_features = pyramid_icp && global_alignment; // only the pyramid ICP uses them
+        config.feature_leaf_size = feature_leaf_size;
+        config.feature_radius = feature_radius;
+        return config;
+    }
+};
+
+
+/**
+ * Result of the pose estimation of one object.
+ */
+struct PoseEstimate {
+    geometry_msgs::PoseStamped pose;
+    PointCloudRGBPtr mesh;    // mesh of the label
+    PointCloudRGBPtr aligned; // mesh moved onto the object
+    tf::Matrix3x3 rotation;
+    std::string error;
+};
+
+class CloudTransformer;
+
+std::vector<PointCloudRGBNormalPtr>     findCluster(const PointCloudRGBPtr kinect,
+                                                    CloudTransformer &transformer,
+                                                    SearchCache &search_cache,
+                                                    std::vector<Eigen::VectorXf> &plane_hints,
+                                                    PointCloudRGBPtr cropped_buffer);
+std::vector<PointCloudRGBNormalPtr>     findClusterOrganized(const PointCloudRGBPtr kinect,
+                                                             SearchCache &search_cache,
+                                                             PointCloudRGBPtr cropped_buffer);
 PointStamped                            findCenterGazebo();
-geometry_msgs::PoseStamped      findPose(const PointCloudRGBPtr input, std::string label);
-PointCloudNormalPtr             estimateSurfaceNormals(PointCloudRGBPtr input);
-PointIndices                    estimatePlaneIndices(PointCloudRGBPtr input);
-PointCloudRGBPtr                extractCluster(PointCloudRGBPtr input,
+geometry_msgs::PoseStamped      findPose(const PointCloudRGBNormalPtr input, std::string label);
+bool                            estimatePose(const PointCloudRGBNormalPtr input,
+                                             const std::string &label,
+                                             PoseEstimate &estimate);
+PointIndices                    estimatePlaneIndices(PointCloudRGBNormalPtr input,
+                                                     const std::vector<int> &indices,
+                                                     const std::vector<Eigen::VectorXf> &hints,
+                                                     size_t min_inliers,
+                                                     Eigen::VectorXf &coefficients);
+PointCloudRGBNormalPtr          extractCluster(PointCloudRGBNormalPtr input,
                                                PointIndices indices,
                                                bool negative);
 PointCloudRGBPtr                apply3DFilter(PointCloudRGBPtr input,
                                               float x,
                                               float y,
-                                              float z);
-PointCloudRGBPtr                mlsFilter(PointCloudRGBPtr input);
-std::vector<PointCloudRGBPtr>   euclideanClusterExtraction(PointCloudRGBPtr input);
-PointCloudRGBPtr                voxelGridFilter(PointCloudRGBPtr input);
-PointCloudVFHS308Ptr            cvfhRecognition(PointCloudRGBPtr input);
-PointCloudRGBPtr                iterativeClosestPoint(PointCloudRGBPtr input, PointCloudRGBPtr target);
-std::vector<uint64_t>           produceColorHist(PointCloudRGBPtr cloud);
-std::vector<float>              getCVFHFeatures(std::vector<PointCloudRGBPtr> all_clusters);
-std::vector<uint64_t>           getColorFeatures(std::vector<PointCloudRGBPtr> all_clusters);
+                                              float z,
+                                              bool keep_organized = false,
+                                              PointCloudRGBPtr output = PointCloudRGBPtr());
+PointCloudRGBNormalPtr          segmentPlanes(PointCloudRGBNormalPtr cloud_cluster,
+                                              std::vector<Eigen::VectorXf> &plane_hints);
+PointCloudRGBPtr                iterativeClosestPoint(PointCloudRGBPtr input,
+                                                      PointCloudRGBPtr target,
+                                                      Eigen::Matrix4f &transformation);
+PointCloudRGBPtr                pyramidIterativeClosestPoint(PointCloudRGBNormalPtr input,
+                                                             const ObjectModel &model,
+                                                             const std::vector<IcpLevel> &levels,
+                                                             bool point_to_plane,
+                                                             bool global_alignment,
+                                                             Eigen::Matrix4f &mesh_transformation);
+bool                            globalAlignment(PointCloudRGBNormalPtr input,
+                                                const ObjectModel &model,
+                                                Eigen::Matrix4f &transformation);
+void                            getCVFHFeatures(PointCloudRGBNormalPtr cluster,
+                                                SearchCache &search_cache,
+                                                float *features);
+void                            getColorFeatures(PointCloudRGBNormalPtr cluster, float *features);
+void                            getObjectFeatures(PointCloudRGBNormalPtr cluster,
+                                                  SearchCache *search_cache,
+                                                  float *cvfh_features,
+                                                  float *color_features);
+void                            getCVFHFeatures(std::vector<PointCloudRGBNormalPtr> all_clusters,
+                                                SearchCache &search_cache,
+                                                float *features);
+void                            getColorFeatures(std::vector<PointCloudRGBNormalPtr> all_clusters, float *features);
 PointCloudRGBPtr                getTargetByLabel(std::string label, Eigen::Vector4f centroid);
 
-extern PointCloudRGBPtr cloud_global;
+extern PerceptionParams perception_params;
+extern ModelRegistry model_registry;
+
+extern boost::mutex debug_clouds_mutex;
+extern PointCloudRGBNormalPtr cloud_global;
 extern PointCloudRGBPtr cloud_perceived;
 extern PointCloudRGBPtr cloud_aligned;
 extern PointCloudRGBPtr cloud_mesh;
@@ -0,0 +1,364 @@
+#include "perception_core.h"
+
+#include <pcl/common/io.h>
+
+#include <limits>
+
+/**
+ * Estimates the normals of a PointCloud with NormalEstimation, searching the neighbors with tree.
+ */
+template<typename PointT>
+PointCloudNormalPtr estimateNormals(const typename pcl::PointCloud<PointT>::Ptr &input,
+                                    const typename pcl::search::KdTree<PointT>::Ptr &tree,
+                                    float radius) {
+    pcl::NormalEstimation<PointT, pcl::Normal> ne;
+    ne.setInputCloud(input);
+    ne.setSearchMethod(tree);
+
+    PointCloudNormalPtr cloud_normals(new PointCloudNormal);
+
+    ne.setRadiusSearch(radius); // Use all neighbors in a sphere of this radius
+
+    ne.compute(*cloud_normals);
+
+    PCL_DEBUG("Estimated the normals of %lu points\n", cloud_normals->size());
+    return cloud_normals;
+}
+
+/**
+ * Estimates surface normals.
+ * @param Pointcloud input
+ * @param radius of the neighborhood of a point, e.g. PerceptionCoreParams::normal_radius
+ * @return The estimated surface normals of the input Pointcloud
+ */
+PointCloudNormalPtr estimateSurfaceNormals(PointCloudRGBPtr input, float radius) {
+    return estimateNormals<pcl::PointXYZRGB>(input, SearchCache::KdTreeRGB::Ptr(new SearchCache::KdTreeRGB), radius);
+}
+
+/**
+ * Estimates surface normals of a PointCloud that already has normals, e.g. from mlsFilter(),
+ * ignoring them. The neighbors are searched with tree, which must have been built on input.
+ * @param input PointCloud
+ * @param tree KdTree of input, e.g. from a SearchCache
+ * @param radius of the neighborhood of a point, e.g. PerceptionCoreParams::normal_radius
+ * @return The estimated surface normals of the input PointCloud
+ */
+PointCloudNormalPtr estimateSurfaceNormals(PointCloudRGBNormalPtr input, SearchCache::KdTreeRGBNormal::Ptr tree,
+                                           float radius) {
+    return estimateNormals<pcl::PointXYZRGBNormal>(input, tree, radius);
+}
+
+/**
+ * Estimates surface normals of an organized PointCloud using integral images.
+ * Much faster than estimateSurfaceNormals(), but only works on organized clouds.
+ * @param input organized PointCloud
+ * @return The estimated surface normals, organized like the input
+ */
+PointCloudNormalPtr estimateIntegralImageNormals(PointCloudRGBPtr input) {
+    PCL_INFO("ESTIMATING INTEGRAL IMAGE NORMALS\n");
+    PointCloudNormalPtr cloud_normals(new PointCloudNormal);
+
+    pcl::IntegralImageNormalEstimation<pcl::PointXYZRGB, pcl::Normal> ne;
+    ne.setNormalEstimationMethod(ne.COVARIANCE_MATRIX);
+    ne.setMaxDepthChangeFactor(0.02f);
+    ne.setNormalSmoothingSize(10.0f);
+    ne.setInputCloud(input);
+    ne.compute(*cloud_normals);
+
+    return cloud_normals;
+}
+
+/**
+ * Crops a PointCloud to an axis aligned box in a single pass.
+ * All three axes are tested at once and the survivors are written straight into output,
+ * whose memory is reused if it has been used before. NaN points never survive.
+ * @param input PointCloud
+ * @param min_pt lower bounds for x, y and z
+ * @param max_pt upper bounds for x, y and z
+ * @param keep_organized if true, filtered points are set to NaN instead of being removed
+ * @param output PointCloud to write to
+ * @return Number of points inside the box
+ */
+size_t cropBoxFilter(const PointCloudRGB &input,
+                     const Eigen::Vector3f &min_pt,
+                     const Eigen::Vector3f &max_pt,
+                     bool keep_organized,
+                     PointCloudRGB &output) {
+    const size_t size = input.points.size();
+    const float min_x = min_pt.x(), min_y = min_pt.y(), min_z = min_pt.z();
+    const float max_x = max_pt.x(), max_y = max_pt.y(), max_z = max_pt.z();
+    size_t count = 0;
+
+    output.header = input.header;
+    output.sensor_origin_ = input.sensor_origin_;
+    output.sensor_orientation_ = input.sensor_orientation_;
+    output.points.resize(size); // no allocation once the buffer has seen a full frame
+    if (size == 0) {
+        output.width = 0;
+        output.height = 1;
+        output.is_dense = true;
+        return 0;
+    }
+
+    const pcl::PointXYZRGB *in = &input.points[0];
+    pcl::PointXYZRGB *out = &output.points[0];
+
+    if (keep_organized) {
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        for (size_t i = 0; i < size; i++) {
+            const pcl::PointXYZRGB &p = in[i];
+            // Bitwise and instead of && keeps the loop free of branches
+            const bool inside = (p.x >= min_x) & (p.x <= max_x) &
+                                (p.y >= min_y) & (p.y <= max_y) &
+                                (p.z >= min_z) & (p.z <= max_z);
+            out[i] = p;
+            out[i].x = inside ? p.x : nan;
+            out[i].y = inside ? p.y : nan;
+            out[i].z = inside ? p.z : nan;
+            count += inside;
+        }
+        output.width = input.width;
+        output.height = input.height;
+        output.is_dense = (count == size);
+    } else {
+        for (size_t i = 0; i < size; i++) {
+            const pcl::PointXYZRGB &p = in[i];
+            const bool inside = (p.x >= min_x) & (p.x <= max_x) &
+                                (p.y >= min_y) & (p.y <= max_y) &
+                                (p.z >= min_z) & (p.z <= max_z);
+            // Always write, but only keep the point by advancing count if it is inside
+            out[count] = p;
+            count += inside;
+        }
+        output.points.resize(count);
+        output.width = count;
+        output.height = 1;
+        output.is_dense = true;
+    }
+
+    return count;
+}
+/**
+ * Filters the input cloud with a moving least squares algorithm.
+ * The normals computed by MLS are kept, so later stages don't have to estimate them again.
+ * @param PointCloud input
+ * @param params polynomial order and search radius
+ * @return The filtered PointCloud with normals, oriented towards the kinect
+ */
+PointCloudRGBNormalPtr mlsFilter(PointCloudRGBPtr input, const PerceptionCoreParams &params) {
+    PCL_INFO("MLS Filter!\n");
+    PointCloudRGBNormalPtr result(new PointCloudRGBNormal);
+
+    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZRGB>);
+    pcl::PointCloud<pcl::PointNormal> mls_points;
+    pcl::MovingLeastSquares<pcl::PointXYZRGB, pcl::PointNormal> mls;
+
+    mls.setComputeNormals(true);
+    mls.setInputCloud(input);
+    mls.setPolynomialOrder(params.mls_polynomial_order); // the lower the smoother, the higher the more exact
+    mls.setSearchMethod(tree);
+    mls.setSearchRadius(params.mls_search_radius);
+    mls.process(mls_points);
+
+    // MLS doesn't keep the colors, so take them from the input points the MLS points belong to
+    pcl::PointIndicesPtr corresponding_indices = mls.getCorrespondingIndices();
+
+    result->points.reserve(mls_points.size());
+    for (int i = 0; i < mls_points.size(); i++) {
+        const pcl::PointNormal &mls_point = mls_points.points[i];
+        const pcl::PointXYZRGB &input_point = input->points[corresponding_indices->indices[i]];
+        pcl::PointXYZRGBNormal point;
+
+        point.x = mls_point.x;
+        point.y = mls_point.y;
+        point.z = mls_point.z;
+        point.normal_x = mls_point.normal_x;
+        point.normal_y = mls_point.normal_y;
+        point.normal_z = mls_point.normal_z;
+        point.curvature = mls_point.curvature;
+        point.rgba = input_point.rgba;
+
+        // Towards the kinect, like pcl::NormalEstimation orients its normals
+        pcl::flipNormalTowardsViewpoint(point, 0.0f, 0.0f, 0.0f,
+                                        point.normal_x, point.normal_y, point.normal_z);
+        result->points.push_back(point);
+    }
+    result->width = result->points.size();
+    result->height = 1;
+    result->header = input->header;
+    PCL_INFO("size: %lu\n", result->size());
+    PCL_INFO("Finished MLS Filter!\n");
+    return result;
+}
+
+
+/**
+ * Filters the input cloud with a voxel grid filter.
+ * @param PointCloud input
+ * @param leaf_size edge length of the voxels
+ * @return Filtered PointCloud
+ */
+PointCloudRGBPtr voxelGridFilter(PointCloudRGBPtr input, float leaf_size) {
+    PointCloudRGBPtr result(new PointCloudRGB);
+
+    pcl::VoxelGrid<pcl::PointXYZRGB> sor;
+    sor.setInputCloud(input);
+    sor.setLeafSize(leaf_size, leaf_size, leaf_size);
+    sor.filter(*result);
+    PCL_INFO("size: %lu\n", result->size());
+    return result;
+}
+
+/**
+ * Downsamples a PointCloud with normals. The averaged normals are normalized again.
+ * @param input PointCloud
+ * @param leaf_size edge length of the voxels, 0 returns the input itself
+ * @return Downsampled PointCloud
+ */
+PointCloudRGBNormalPtr voxelGridFilterWithNormals(PointCloudRGBNormalPtr input, float leaf_size) {
+    if (leaf_size <= 0.0f) {
+        return input;
+    }
+    PointCloudRGBNormalPtr result(new PointCloudRGBNormal);
+
+    pcl::VoxelGrid<pcl::PointXYZRGBNormal> sor;
+    sor.setInputCloud(input);
+    sor.setLeafSize(leaf_size, leaf_size, leaf_size);
+    sor.filter(*result);
+    for (size_t i = 0; i < result->points.size(); i++) {
+        result->points[i].getNormalVector3fMap().normalize();
+    }
+    return result;
+}
+
+/**
+ * Sets the thresholds of the smooth regions and computes the CVFH features.
+ */
+template<typename PointNT>
+void computeCVFH(pcl::CVFHEstimation<pcl::PointXYZRGBNormal, PointNT, pcl::VFHSignature308> &cvfh,
+                 const PerceptionCoreParams &params, pcl::PointCloud<pcl::VFHSignature308> &descriptors) {
+    cvfh.setEPSAngleThreshold(params.cvfh_eps_angle);
+    cvfh.setCurvatureThreshold(params.cvfh_curvature_threshold);
+    cvfh.setNormalizeBins(false);
+    PCL_INFO("CVFH recognition parameters set. Computing now...\n");
+    cvfh.compute(descriptors);
+    PCL_INFO("CVFH features computed successfully!\n");
+}
+
+/**
+ * Estimates features of an object in a PointCloud using VFHSignature308.
+ * The shipped forests were trained with the normals of estimateSurfaceNormals(), so by default
+ * they are estimated again on the object. The normal estimation and CVFH then share the KdTree
+ * of the object from search_cache. With params.cvfh_mls_normals the normals stored in the input,
+ * which mlsFilter() already computed, are used instead. If the input is a view of a bigger cloud,
+ * the features are then computed on the bigger cloud with the indices of the view, so its KdTree
+ * can be reused.
+ * @param input PointCloud with normals
+ * @param search_cache to borrow the KdTree from
+ * @param params thresholds of the smooth regions and the source of the normals
+ * @return VFHSignature308 Features
+ */
+PointCloudVFHS308Ptr cvfhRecognition(PointCloudRGBNormalPtr input, SearchCache &search_cache,
+                                     const PerceptionCoreParams &params) {
+    PCL_INFO("CVFH Recognition!\n");
+    // Object for storing the CVFH descriptors.
+    PointCloudVFHS308Ptr descriptors(new pcl::PointCloud<pcl::VFHSignature308>);
+
+    if (!params.cvfh_mls_normals) {
+        // Only the normals are estimated again, the points and their tree stay the same
+        SearchCache::KdTreeRGBNormal::Ptr tree = search_cache.getKdTree(input);
+        pcl::CVFHEstimation<pcl::PointXYZRGBNormal, pcl::Normal, pcl::VFHSignature308> cvfh;
+        cvfh.setInputCloud(input);
+        cvfh.setInputNormals(estimateSurfaceNormals(input, tree, params.normal_radius));
+        cvfh.setSearchMethod(tree);
+        computeCVFH(cvfh, params, *descriptors);
+        return descriptors;
+    }
+
+    // CVFH estimation object. The input cloud carries its own normals.
+    pcl::CVFHEstimation<pcl::PointXYZRGBNormal, pcl::PointXYZRGBNormal, pcl::VFHSignature308> cvfh;
+    SearchCache::CloudView view;
+    if (search_cache.getView(input, view)) {
+        cvfh.setInputCloud(view.parent);
+        cvfh.setInputNormals(view.parent);
+        cvfh.setIndices(view.indices);
+        cvfh.setSearchMethod(search_cache.getKdTree(view.parent));
+    } else {
+        cvfh.setInputCloud(input);
+        cvfh.setInputNormals(input);
+        cvfh.setSearchMethod(search_cache.getKdTree(input));
+    }
+    computeCVFH(cvfh, params, *descriptors);
+
+    return descriptors;
+}
+
+/**
+ * Seperates clusters from each other using euclidean cluster extraction.
+ * Every cluster is registered as a view of the input in search_cache.
+ * @param input PointCloud
+ * @param search_cache to borrow the KdTree from
+ * @param params tolerance and size limits of the clusters
+ * @return Seperated PointClouds, largest first
+ */
+std::vector<PointCloudRGBNormalPtr> euclideanClusterExtraction(PointCloudRGBNormalPtr input,
+                                                               SearchCache &search_cache,
+                                                               const PerceptionCoreParams &params) {
+    PCL_INFO("Euclidean Cluster Extraction!\n");
+    SearchCache::KdTreeRGBNormal::Ptr tree = search_cache.getKdTree(input);
+
+    // pcl::EuclideanClusterExtraction would build the tree again, so use the function directly
+    PointIndicesVector cluster_indices;
+    pcl::extractEuclideanClusters(*input, tree, params.cluster_tolerance, cluster_indices,
+                                  params.min_cluster_size, params.max_cluster_size);
+
+    std::vector<PointCloudRGBNormalPtr> result;
+
+    for (std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin();
+         it != cluster_indices.end(); ++it) {
+        PointCloudRGBNormalPtr cloud_cluster(new PointCloudRGBNormal);
+        for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); ++pit)
+            cloud_cluster->points.push_back(input->points[*pit]);
+        cloud_cluster->width = cloud_cluster->points.size();
+        cloud_cluster->height = 1;
+        cloud_cluster->is_dense = true;
+
+        PCL_INFO("PointCloud representing the Cluster: %lu data points.\n", cloud_cluster->points.size());
+
+        search_cache.addView(cloud_cluster, input, PointIndices(new pcl::PointIndices(*it)));
+        result.push_back(cloud_cluster);
+    }
+
+
+    PCL_INFO("Finished Euclidean Cluster Extraction!\n");
+    return result;
+}
+
+
+/**
+ * Estimates the FPFH features of a PointCloud, using its normals.
+ * @param input PointCloud with normals
+ * @param radius of the neighborhood of a point
+ * @return One feature per point
+ */
+PointCloudFPFHPtr computeFPFHFeatures(PointCloudRGBNormalPtr input, float radius) {
+    PointCloudFPFHPtr features(new PointCloudFPFH);
+    pcl::FPFHEstimation<pcl::PointXYZRGBNormal, pcl::PointXYZRGBNormal, pcl::FPFHSignature33> fpfh;
+    pcl::search::KdTree<pcl::PointXYZRGBNormal>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZRGBNormal>);
+    fpfh.setInputCloud(input);
+    fpfh.setInputNormals(input);
+    fpfh.setSearchMethod(tree);
+    fpfh.setRadiusSearch(radius);
+    fpfh.compute(*features);
+    return features;
+}
+
+/**
+ * Gets the color histogram from a PointCloud.
+ * @param Input PointCloud cloud
+ * @param params binning of the histogram, the default is what the classifier was trained with
+ * @return Concatenated bin counts (r,g,b) from PointCloud points
+ */
+std::vector<uint64_t> produceColorHist(PointCloudRGBNormalPtr cloud, const PerceptionCoreParams &params) {
+    return computeColorHistogram(*cloud, params.color_histogram);
+}
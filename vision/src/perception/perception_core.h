@@ -0,0 +1,73 @@
+#ifndef VISION_PERCEPTION_CORE_H
+#define VISION_PERCEPTION_CORE_H
+
+#include <pcl/console/print.h>
+#include <pcl/features/cvfh.h>
+#include <pcl/features/fpfh.h>
+#include <pcl/features/integral_image_normal.h>
+#include <pcl/features/normal_3d.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/segmentation/extract_clusters.h>
+#include <pcl/surface/mls.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "short_types.h"
+#include "search_cache.h"
+#include "color_histogram.h"
+
+#include <cmath>
+#include <vector>
+
+/**
+ * Filters and features of the perception that don't need ROS. Built as the vision_perception_core
+ * library, which the vision node, the benchmarks and the batch_processor share, so the features used
+ * for training and at runtime are computed by the same code. Logs with the PCL console.
+ */
+
+/**
+ * Parameters of the filters and features. The defaults are what the vision node uses.
+ */
+struct PerceptionCoreParams {
+    float voxel_leaf_size;          // edge length of the voxels of voxelGridFilter()
+    int mls_polynomial_order;       // the lower the smoother, the higher the more exact
+    float mls_search_radius;
+    float normal_radius;            // neighborhood of estimateSurfaceNormals(), the forests were trained with 3 cm
+    float cluster_tolerance;        // points closer than this belong to the same cluster
+    int min_cluster_size;
+    int max_cluster_size;
+    float cvfh_eps_angle;           // radians, maximum normal deviation within a smooth region
+    float cvfh_curvature_threshold;
+    bool cvfh_mls_normals;          // CVFH uses the MLS normals, needs forests trained with them
+    ColorHistogramConfig color_histogram;
+
+    PerceptionCoreParams() : voxel_leaf_size(0.005f), mls_polynomial_order(1), mls_search_radius(0.03f),
+                             normal_radius(0.03f), cluster_tolerance(0.01f), min_cluster_size(100), max_cluster_size(100000),
+                             cvfh_eps_angle(5.0f / 180.0f * M_PI), cvfh_curvature_threshold(1.0f),
+                             cvfh_mls_normals(false) {}
+};
+
+PointCloudNormalPtr             estimateSurfaceNormals(PointCloudRGBPtr input, float radius);
+PointCloudNormalPtr             estimateSurfaceNormals(PointCloudRGBNormalPtr input,
+                                                       SearchCache::KdTreeRGBNormal::Ptr tree,
+                                                       float radius);
+PointCloudNormalPtr             estimateIntegralImageNormals(PointCloudRGBPtr input);
+size_t                          cropBoxFilter(const PointCloudRGB &input,
+                                              const Eigen::Vector3f &min_pt,
+                                              const Eigen::Vector3f &max_pt,
+                                              bool keep_organized,
+                                              PointCloudRGB &output);
+PointCloudRGBPtr                voxelGridFilter(PointCloudRGBPtr input, float leaf_size);
+PointCloudRGBNormalPtr          voxelGridFilterWithNormals(PointCloudRGBNormalPtr input, float leaf_size);
+PointCloudRGBNormalPtr          mlsFilter(PointCloudRGBPtr input, const PerceptionCoreParams &params);
+std::vector<PointCloudRGBNormalPtr> euclideanClusterExtraction(PointCloudRGBNormalPtr input,
+                                                               SearchCache &search_cache,
+                                                               const PerceptionCoreParams &params);
+PointCloudVFHS308Ptr            cvfhRecognition(PointCloudRGBNormalPtr input,
+                                                SearchCache &search_cache,
+                                                const PerceptionCoreParams &params);
+PointCloudFPFHPtr               computeFPFHFeatures(PointCloudRGBNormalPtr input, float radius);
+std::vector<uint64_t>           produceColorHist(PointCloudRGBNormalPtr cloud, const PerceptionCoreParams &params);
+
+#endif //VISION_PERCEPTION_CORE_H
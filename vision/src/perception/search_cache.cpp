@@ -0,0 +1,99 @@
+#include "search_cache.h"
+
+SearchCache::SearchCache() : builds_(0), hits_(0) {
+}
+
+/**
+ * Returns a KdTree over the given cloud. It is only built if there is none for this version of the cloud yet.
+ * @param cloud PointCloud
+ * @return KdTree with cloud as input
+ */
+SearchCache::KdTreeRGB::Ptr SearchCache::getKdTree(const PointCloudRGBPtr &cloud) {
+    boost::mutex::scoped_lock lock(mutex_);
+    return lookup<pcl::PointXYZRGB>(rgb_entries_, cloud);
+}
+
+/**
+ * Returns a KdTree over the given cloud. It is only built if there is none for this version of the cloud yet.
+ * @param cloud PointCloud
+ * @return KdTree with cloud as input
+ */
+SearchCache::KdTreeRGBNormal::Ptr SearchCache::getKdTree(const PointCloudRGBNormalPtr &cloud) {
+    boost::mutex::scoped_lock lock(mutex_);
+    return lookup<pcl::PointXYZRGBNormal>(rgb_normal_entries_, cloud);
+}
+
+/**
+ * Remembers that cloud is a copy of the points of parent at indices.
+ * @param cloud the copied PointCloud
+ * @param parent the PointCloud it was copied from
+ * @param indices of the copied points in parent
+ */
+void SearchCache::addView(const PointCloudRGBNormalPtr &cloud, const PointCloudRGBNormalPtr &parent,
+                          PointIndices indices) {
+    boost::mutex::scoped_lock lock(mutex_);
+    CloudView view;
+    view.parent = parent;
+    view.indices = indices;
+    views_.push_back(std::make_pair(cloud, view));
+}
+
+/**
+ * Finds out whether cloud has been registered as a view of a bigger cloud.
+ * @param cloud PointCloud
+ * @param view filled with the parent cloud and the indices, if there is one
+ * @return true if cloud is a view
+ */
+bool SearchCache::getView(const PointCloudRGBNormalPtr &cloud, CloudView &view) {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (int i = 0; i < views_.size(); i++) {
+        if (views_[i].first == cloud && views_[i].first->points.size() == views_[i].second.indices->indices.size()) {
+            view = views_[i].second;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @return How many trees have been built
+ */
+int SearchCache::getBuilds() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return builds_;
+}
+
+/**
+ * @return How many times a tree could be reused
+ */
+int SearchCache::getHits() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return hits_;
+}
+
+template<typename PointT>
+typename pcl::search::KdTree<PointT>::Ptr SearchCache::lookup(std::vector<Entry<PointT> > &entries,
+                                                              const typename pcl::PointCloud<PointT>::Ptr &cloud) {
+    const PointT *data = cloud->points.empty() ? NULL : &cloud->points[0];
+    for (int i = 0; i < entries.size(); i++) {
+        if (entries[i].cloud == cloud) {
+            if (entries[i].size == cloud->points.size() && entries[i].data == data) {
+                hits_++;
+                return entries[i].tree;
+            }
+            // The cloud has been changed since its tree was built
+            entries.erase(entries.begin() + i);
+            break;
+        }
+    }
+
+    Entry<PointT> entry;
+    entry.cloud = cloud;
+    entry.size = cloud->points.size();
+    entry.data = data;
+    entry.tree.reset(new pcl::search::KdTree<PointT>);
+    entry.tree->setInputCloud(cloud);
+    entries.push_back(entry);
+    builds_++;
+    return entry.tree;
+}
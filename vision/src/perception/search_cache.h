@@ -0,0 +1,60 @@
+#ifndef VISION_SEARCH_CACHE_H
+#define VISION_SEARCH_CACHE_H
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/search/kdtree.h>
+#include <boost/thread/mutex.hpp>
+
+#include "short_types.h"
+
+#include <vector>
+
+/**
+ * Frame scoped cache of spatial search structures.
+ * Every stage that needs a KdTree borrows it from here, so a tree is only built once per cloud.
+ * Clusters that were copied out of a bigger cloud can be registered as views, so a stage can run
+ * on the bigger cloud with the cluster indices and reuse its tree instead of building a new one.
+ * Create one per request and throw it away afterwards.
+ */
+class SearchCache {
+public:
+    typedef pcl::search::KdTree<pcl::PointXYZRGB> KdTreeRGB;
+    typedef pcl::search::KdTree<pcl::PointXYZRGBNormal> KdTreeRGBNormal;
+
+    /** A cloud that has been copied out of parent using indices. **/
+    struct CloudView {
+        PointCloudRGBNormalPtr parent;
+        PointIndices indices;
+    };
+
+    SearchCache();
+    KdTreeRGB::Ptr getKdTree(const PointCloudRGBPtr &cloud);
+    KdTreeRGBNormal::Ptr getKdTree(const PointCloudRGBNormalPtr &cloud);
+    void addView(const PointCloudRGBNormalPtr &cloud, const PointCloudRGBNormalPtr &parent, PointIndices indices);
+    bool getView(const PointCloudRGBNormalPtr &cloud, CloudView &view);
+    int getBuilds();
+    int getHits();
+
+private:
+    template<typename PointT>
+    struct Entry {
+        typename pcl::PointCloud<PointT>::Ptr cloud;  // keeps the cloud alive, so its address stays unique
+        size_t size;                                  // size and data identify the version of the cloud
+        const PointT *data;
+        typename pcl::search::KdTree<PointT>::Ptr tree;
+    };
+
+    template<typename PointT>
+    typename pcl::search::KdTree<PointT>::Ptr lookup(std::vector<Entry<PointT> > &entries,
+                                                     const typename pcl::PointCloud<PointT>::Ptr &cloud);
+
+    std::vector<Entry<pcl::PointXYZRGB> > rgb_entries_;
+    std::vector<Entry<pcl::PointXYZRGBNormal> > rgb_normal_entries_;
+    std::vector<std::pair<PointCloudRGBNormalPtr, CloudView> > views_;
+    int builds_;
+    int hits_;
+    boost::mutex mutex_;
+};
+
+#endif //VISION_SEARCH_CACHE_H
@@ -8,23 +8,23 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include <pcl/PointIndices.h>
-#include <geometry_msgs/PointStamped.h>
-#include <sensor_msgs/PointCloud2.h>
 
 typedef pcl::PointCloud<pcl::PointXYZ>::Ptr PointCloudXYZPtr;
 typedef pcl::PointCloud<pcl::PointXYZRGB>::Ptr PointCloudRGBPtr;
+typedef pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr PointCloudRGBNormalPtr;
 typedef pcl::PointCloud<pcl::Normal>::Ptr PointCloudNormalPtr;
 typedef pcl::PointCloud<pcl::PointNormal>::Ptr PointCloudPointNormalPtr;
 typedef pcl::PointCloud<pcl::PointXYZ> PointCloudXYZ;
 typedef pcl::PointCloud<pcl::PointXYZRGB> PointCloudRGB;
+typedef pcl::PointCloud<pcl::PointXYZRGBNormal> PointCloudRGBNormal;
 typedef pcl::PointCloud<pcl::Normal> PointCloudNormal;
 typedef pcl::PointIndices::Ptr PointIndices;
 typedef std::vector<pcl::PointIndices> PointIndicesVector;
 typedef std::vector<pcl::PointIndices::Ptr> PointIndicesVectorPtr;
 
-typedef geometry_msgs::PointStamped PointStamped;
 typedef pcl::PointCloud<pcl::VFHSignature308>::Ptr PointCloudVFHS308Ptr;
-typedef sensor_msgs::PointCloud2 SMSGSPointCloud2;
+typedef pcl::PointCloud<pcl::FPFHSignature33>::Ptr PointCloudFPFHPtr;
+typedef pcl::PointCloud<pcl::FPFHSignature33> PointCloudFPFH;
 typedef std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> PointCloudXYZPtrVector;
 
 
@@ -8,129 +8,144 @@
 #include "../../saving/saving.h"
 
 
-CloudTransformer::CloudTransformer(ros::NodeHandle nh) : nh_(nh) {
-
-        buffer_.reset(new PointCloudRGB); // (new sensor_msgs::PointCloud2)
-        buffer_->header.frame_id = "odom_combined";
+CloudTransformer::CloudTransformer(ros::NodeHandle nh) : nh_(nh), listener_(nh) {
+}
 
+/**
+ * Looks up the latest transform between two frames without waiting for tf.
+ * If tf doesn't know the transform (yet), the last one found is used instead.
+ * @param target_frame
+ * @param source_frame
+ * @param transform returns the transform from source_frame to target_frame
+ * @return false if the transform has never been available
+ */
+bool CloudTransformer::lookupTransform(const std::string &target_frame, const std::string &source_frame,
+                                       Eigen::Affine3d &transform) {
+    const FramePair frames(target_frame, source_frame);
+    tf::StampedTransform stamped_transform;
+    try {
+        listener_.lookupTransform(target_frame, source_frame, ros::Time(0), stamped_transform);
+        boost::mutex::scoped_lock lock(cache_mutex_);
+        cache_[frames] = stamped_transform;
+    }
+    catch (tf::TransformException &ex) {
+        boost::mutex::scoped_lock lock(cache_mutex_);
+        std::map<FramePair, tf::StampedTransform>::const_iterator cached = cache_.find(frames);
+        if (cached == cache_.end()) {
+            ROS_ERROR("%s", ex.what());
+            return false;
+        }
+        stamped_transform = cached->second;
+        ROS_WARN("%s Using the transform from %.2fs ago.", ex.what(),
+                 (ros::Time::now() - stamped_transform.stamp_).toSec());
+    }
+    tf::transformTFToEigen(stamped_transform, transform);
+    return true;
 }
 
 /**
  * Finds the main plane (-> table, etc.) and extracts only the points above that plane.
+ * The plane is segmented in the kinect frame and only single points are transformed into base_link,
+ * so the cloud is neither copied nor transformed as a whole.
  * @param input PointCloud
  * @return Extracted PointCloud
  */
-PointCloudRGBPtr CloudTransformer::extractAbovePlane(PointCloudRGBPtr input) {
+PointCloudRGBNormalPtr CloudTransformer::extractAbovePlane(PointCloudRGBNormalPtr input) {
     ROS_INFO("Removing points below the ground plane...");
-    PointCloudRGBPtr cloud_odom_combined(new PointCloudRGB);
-
-    cloud_odom_combined = CloudTransformer::transform(input, "base_link", "head_mount_kinect_rgb_optical_frame");
+    Eigen::Affine3d kinect_to_base_d;
+    if (!lookupTransform("base_link", "head_mount_kinect_rgb_optical_frame", kinect_to_base_d)) {
+        ROS_ERROR("Can't find the ground plane without a transform to base_link");
+        return input;
+    }
+    const Eigen::Affine3f kinect_to_base = kinect_to_base_d.cast<float>();
 
-    // Find the bottom plane
+    // Find the bottom plane. It has to be perpendicular to the z axis of base_link,
+    // which is rotated into the kinect frame.
+    Eigen::Vector3f up = kinect_to_base.linear().transpose() * Eigen::Vector3f::UnitZ();
     PointIndices planeIndices(new pcl::PointIndices);
     ROS_INFO("FINDING PLANE");
     pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
-    pcl::SACSegmentation<pcl::PointXYZRGB> segmentation;
-    segmentation.setInputCloud(cloud_odom_combined);
+    pcl::SACSegmentation<pcl::PointXYZRGBNormal> segmentation;
+    segmentation.setInputCloud(input);
     segmentation.setModelType(pcl::SACMODEL_PERPENDICULAR_PLANE);
     segmentation.setMethodType(pcl::SAC_RANSAC);
     segmentation.setMaxIterations(500); // Default is 50 and could be problematic
-    segmentation.setAxis(Eigen::Vector3f(0, 0, 1));
-    segmentation.setEpsAngle(5.0f * (M_PI / 180.0f)); // plane can be within 5 degrees of X-Z plane
+    segmentation.setAxis(up);
+    segmentation.setEpsAngle(5.0f * (M_PI / 180.0f)); // normal within 5 degrees of the z axis of base_link
     segmentation.setDistanceThreshold(0.02);  // Distance to model points
     segmentation.setOptimizeCoefficients(true);
     segmentation.segment(*planeIndices, *coefficients);
 
-    PointCloudRGBPtr plane(new PointCloudRGB);
-    plane = extractCluster(cloud_odom_combined, planeIndices, false); // extract the plane
-
-    //ROS_INFO("TRYING TO SAVE THE GROUND PLANE");
-    //savePointCloudRGBNamed(plane, "ground_plane");
-
-    // Calculate min and max values of the main plane.
+    if (planeIndices->indices.empty()) {
+        ROS_ERROR("No ground plane found");
+        return input;
+    }
 
+    // Calculate min and max values of the main plane in base_link.
     ROS_INFO("BEFORE CALCULATING MIN AND MAX VALUES");
-    float min_x = plane->points[0].x;
-    float min_y = plane->points[0].y;
-    float min_z = plane->points[0].z;
-
-    float max_x = plane->points[0].x;
-    float max_y = plane->points[0].y;
-
-    for (int i = 1; i < plane->points.size(); i++) {
-        if (plane->points[i].x < min_x) {
-            min_x = plane->points[i].x;
-        }
-        if (plane->points[i].y < min_y) {
-            min_y = plane->points[i].y;
-        }
-        if (plane->points[i].z < min_z) {
-            min_z = plane->points[i].z;
-        }
-        if (plane->points[i].x > max_x) {
-            max_x = plane->points[i].x;
-        }
-        if (plane->points[i].y > max_y) {
-            max_y = plane->points[i].y;
-        }
+    std::vector<bool> is_plane(input->points.size(), false);
+    Eigen::Vector3f min_pt = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+    Eigen::Vector3f max_pt = Eigen::Vector3f::Constant(-std::numeric_limits<float>::max());
+    for (size_t i = 0; i < planeIndices->indices.size(); i++) {
+        const int index = planeIndices->indices[i];
+        const Eigen::Vector3f point = kinect_to_base * input->points[index].getVector3fMap();
+        min_pt = min_pt.cwiseMin(point);
+        max_pt = max_pt.cwiseMax(point);
+        is_plane[index] = true;
     }
 
-    PointCloudRGBPtr cloud_without_plane(new PointCloudRGB);
-    PointCloudRGBPtr result(new PointCloudRGB);
-    cloud_without_plane = extractCluster(cloud_odom_combined, planeIndices, true);
-    // savePointCloudRGBNamed(cloud_without_plane, "without_plane");
-
-    ROS_INFO("Plane height: %f", min_z);
-    ROS_INFO("min_x: %f", min_x);
-    ROS_INFO("max_x: %f", max_x);
-    ROS_INFO("min_y: %f", min_y);
-    ROS_INFO("max_y: %f", max_y);
-
-    // Only add points to the result point cloud that fulfill the min and max values
-    for(int a = 0; a < cloud_without_plane->points.size(); a++){
-        if(     cloud_without_plane->points[a].x >= min_x &&
-                cloud_without_plane->points[a].x <= max_x &&
-                cloud_without_plane->points[a].y >= min_y &&
-                cloud_without_plane->points[a].y <= max_y &&
-                cloud_without_plane->points[a].z >= min_z   ){
-            result->points.push_back(cloud_without_plane->points[a]);
+    ROS_INFO("Plane height: %f", min_pt.z());
+    ROS_INFO("min_x: %f", min_pt.x());
+    ROS_INFO("max_x: %f", max_pt.x());
+    ROS_INFO("min_y: %f", min_pt.y());
+    ROS_INFO("max_y: %f", max_pt.y());
+
+    // Only add points to the result point cloud that aren't part of the plane
+    // and fulfill the min and max values in base_link
+    PointCloudRGBNormalPtr result(new PointCloudRGBNormal);
+    result->header = input->header;
+    result->points.reserve(input->points.size() - planeIndices->indices.size());
+    for (size_t a = 0; a < input->points.size(); a++) {
+        if (is_plane[a]) {
+            continue;
+        }
+        const Eigen::Vector3f point = kinect_to_base * input->points[a].getVector3fMap();
+        if (point.x() >= min_pt.x() &&
+            point.x() <= max_pt.x() &&
+            point.y() >= min_pt.y() &&
+            point.y() <= max_pt.y() &&
+            point.z() >= min_pt.z()) {
+            result->points.push_back(input->points[a]);
         }
     }
-    result->width = 1;
-    result->height = result->points.size();
-
-
-    PointCloudRGBPtr result_transformed_back (new PointCloudRGB);
-    result_transformed_back = CloudTransformer::transform(result, "head_mount_kinect_rgb_optical_frame", "base_link");
-    return result_transformed_back;
-
+    result->width = result->points.size();
+    result->height = 1;
 
+    return result;
 };
 
 /**
- * Transforms a PointCloud into another frame.
+ * Transforms a PointCloud and its normals into another frame.
  * @param cloud
  * @param target_frame
  * @param source_frame
  * @return Transformed PointCloud
  */
-PointCloudRGBPtr CloudTransformer::transform(const PointCloudRGBPtr cloud, std::string target_frame,
+PointCloudRGBNormalPtr CloudTransformer::transform(const PointCloudRGBNormalPtr cloud, std::string target_frame,
                            std::string source_frame) // sensor_msgs::PointCloud2ConstPtr&
 {
     ROS_INFO("TRYING TO TRANSFORM...");
-    try {
-        // Usually: target_frame = "odom_combined", source_frame = "head_mount_kinect_ir_optical_frame"
-        listener_.waitForTransform(target_frame, source_frame, ros::Time(0), ros::Duration(3.0));
-        listener_.lookupTransform(target_frame, source_frame, ros::Time(0), stamped_transform_);
-        tf::transformTFToEigen(stamped_transform_, transform_eigen_);
-        pcl::transformPointCloud(*cloud, *buffer_, transform_eigen_);
-    }
-    catch (tf::TransformException &ex) {
-        ROS_ERROR("%s", ex.what());
-        ros::Duration(1.0).sleep();
+    PointCloudRGBNormalPtr result(new PointCloudRGBNormal);
+    Eigen::Affine3d transform_eigen;
+    // Usually: target_frame = "odom_combined", source_frame = "head_mount_kinect_ir_optical_frame"
+    if (!lookupTransform(target_frame, source_frame, transform_eigen)) {
+        error_message += "No transform from " + source_frame + " to " + target_frame + ". ";
+        return result;
     }
+    pcl::transformPointCloudWithNormals(*cloud, *result, transform_eigen);
+    result->header.frame_id = target_frame;
     //savePointCloudXYZNamed(cloud, "before_transforming");
-    //savePointCloudXYZNamed(buffer_, "transformed");
+    //savePointCloudXYZNamed(result, "transformed");
     ROS_INFO("TRANSFORMED!");
-    return buffer_;
+    return result;
 };
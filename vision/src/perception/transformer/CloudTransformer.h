@@ -11,28 +11,37 @@
 #include <ros/ros.h>
 #include <tf_conversions/tf_eigen.h>
 #include <tf/transform_listener.h>
+#include <boost/thread/mutex.hpp>
 
 #include "../short_types.h"
 #include "../perception.h"
 
+#include <map>
 #include <string>
-
+#include <utility>
+
+/**
+ * Transforms PointClouds between the kinect and the robot frames.
+ * Meant to live as long as the node: the TransformListener fills its buffer in the background,
+ * so lookups never have to wait. The last transform found for every pair of frames is cached
+ * and used whenever tf can't answer.
+ */
 class CloudTransformer {
 private:
+    typedef std::pair<std::string, std::string> FramePair; // target, source
+
     ros::NodeHandle nh_;
-    ros::Subscriber pcl_sub_;
-    //ros::Publisher pcl_pub_;
     tf::TransformListener listener_;
-    tf::StampedTransform stamped_transform_;
-    tf::Transform test_transform_;
-    Eigen::Affine3d transform_eigen_;
-    PointCloudRGBPtr buffer_; // sensor_msgs::PointCloud2::Ptr
+    std::map<FramePair, tf::StampedTransform> cache_;
+    boost::mutex cache_mutex_;
 
 public:
     explicit CloudTransformer(ros::NodeHandle nh);
-    PointCloudRGBPtr transform(const PointCloudRGBPtr cloud, std::string target_frame,
-                               std::string source_frame) ;
-    PointCloudRGBPtr extractAbovePlane(PointCloudRGBPtr input) ;
+    bool lookupTransform(const std::string &target_frame, const std::string &source_frame,
+                         Eigen::Affine3d &transform);
+    PointCloudRGBNormalPtr transform(const PointCloudRGBNormalPtr cloud, std::string target_frame,
+                                     std::string source_frame) ;
+    PointCloudRGBNormalPtr extractAbovePlane(PointCloudRGBNormalPtr input) ;
 
 };
 
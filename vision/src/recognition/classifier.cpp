@@ -110,64 +110,88 @@ bool classifier::train(std::string directory, bool update) {
  */
 
 std::string classifier::classify(std::vector<uint64_t> color_features, std::vector<float> cvfh_features) {
-    if(random_trees_color_classifier->isTrained() && random_trees_cvfh_classifier->isTrained()) {
-        ROS_INFO("Classifying...");
+    cv::Mat color_predictInput = Mat::zeros(1, COLOR_ATTRIBUTES_PER_SAMPLE, CV_32FC1);
+    cv::Mat cvfh_predictInput = Mat::zeros(1, CVFH_ATTRIBUTES_PER_SAMPLE, CV_32FC1);
 
-        cv::Mat color_predictInput;
-        cv::Mat cvfh_predictInput;
-
-        color_predictInput.create(1, COLOR_ATTRIBUTES_PER_SAMPLE, CV_32FC1);
-        cvfh_predictInput.create(1, CVFH_ATTRIBUTES_PER_SAMPLE, CV_32FC1);
-
-        for(int color_index = 0; color_index < color_features.size(); color_index++){
-            color_predictInput.at<float>(0, color_index) = color_features[color_index];
-            //ROS_INFO("%f", predictInput.at<float>(0, color_index));
-        }
-        for(int cvfh_index = 0; cvfh_index < cvfh_features.size(); cvfh_index++){
-            cvfh_predictInput.at<float>(0, cvfh_index) = cvfh_features[cvfh_index];
-            //ROS_INFO("%f", predictInput.at<float>(0, cvfh_index + color_features.size()));
-        }
-        Mat color_predictInput_normalized;
-        Mat cvfh_predictInput_normalized;
-
-        normalize(color_predictInput, color_predictInput_normalized, 1, 0, NORM_L1);
-        normalize(cvfh_predictInput, cvfh_predictInput_normalized, 1, 0, NORM_L1);
+    for(int color_index = 0; color_index < color_features.size() && color_index < COLOR_ATTRIBUTES_PER_SAMPLE; color_index++){
+        color_predictInput.at<float>(0, color_index) = color_features[color_index];
+    }
+    for(int cvfh_index = 0; cvfh_index < cvfh_features.size() && cvfh_index < CVFH_ATTRIBUTES_PER_SAMPLE; cvfh_index++){
+        cvfh_predictInput.at<float>(0, cvfh_index) = cvfh_features[cvfh_index];
+    }
 
-        for(int xD = 0; xD < color_features.size() + cvfh_features.size(); xD++){
-            //ROS_INFO("Feature %d: %f", xD, predictInput_normalized.at<float>(0, xD));
-        }
+    BatchClassification classification;
+    if(!classifyBatch(color_predictInput, cvfh_predictInput, classification)){
+        return "";
+    }
+    return classification.labels[0];
+}
 
-        int color_prediction_result = random_trees_color_classifier->predict(color_predictInput_normalized);
-        int cvfh_prediction_result = random_trees_cvfh_classifier->predict(cvfh_predictInput_normalized);
+/**
+ * Classifies many PointClouds at once, using one normalize and predict pass per forest.
+ * classifier::train() has to be successfully called beforehand.
+ * @param color_features: One row of COLOR_ATTRIBUTES_PER_SAMPLE floats per object (CV_32FC1). Normalized in place.
+ * @param cvfh_features: One row of CVFH_ATTRIBUTES_PER_SAMPLE floats per object (CV_32FC1). Normalized in place.
+ * @param result: Filled with one label and one row of votes per object, in the order of the rows
+ * @return Whether classifying succeeded
+ */
+bool classifier::classifyBatch(cv::Mat &color_features, cv::Mat &cvfh_features, BatchClassification &result) {
+    result.labels.clear();
+    if(!random_trees_color_classifier->isTrained() || !random_trees_cvfh_classifier->isTrained()) {
+        ROS_ERROR("ERROR: Classifier hasn't been trained, or something went wrong while training!");
+        return false;
+    }
+    if(color_features.rows != cvfh_features.rows ||
+       color_features.cols != COLOR_ATTRIBUTES_PER_SAMPLE || cvfh_features.cols != CVFH_ATTRIBUTES_PER_SAMPLE ||
+       color_features.type() != CV_32FC1 || cvfh_features.type() != CV_32FC1) {
+        ROS_ERROR("ERROR: Feature matrices have the wrong size or type!");
+        return false;
+    }
 
-        Mat color_votes;
-        Mat cvfh_votes;
+    int objects = color_features.rows;
+    if(objects == 0){
+        return true;
+    }
+    ROS_INFO("Classifying %d objects...", objects);
+
+    // Every sample is normalized on its own, like the training data
+    for(int i = 0; i < objects; i++){
+        Mat color_row = color_features.row(i);
+        Mat cvfh_row = cvfh_features.row(i);
+        normalize(color_row, color_row, 1, 0, NORM_L1);
+        normalize(cvfh_row, cvfh_row, 1, 0, NORM_L1);
+    }
 
-        random_trees_color_classifier->getVotes(color_predictInput_normalized, color_votes, 0);
-        random_trees_cvfh_classifier->getVotes(cvfh_predictInput_normalized, cvfh_votes, 0);
+    // Every forest is evaluated once. predict() would walk all trees again just to find
+    // the class with the most votes, which can be read from the votes directly.
+    Mat color_votes;
+    Mat cvfh_votes;
+    random_trees_color_classifier->getVotes(color_features, color_votes, 0);
+    random_trees_cvfh_classifier->getVotes(cvfh_features, cvfh_votes, 0);
 
-        Mat combined_votes;
-        cv::add(color_votes, cvfh_votes, combined_votes);
+    // The first row of the votes holds the classes, every other row belongs to one sample
+    Mat classes = color_votes.row(0);
+    result.color_votes = color_votes.rowRange(1, objects + 1);
+    result.cvfh_votes = cvfh_votes.rowRange(1, objects + 1);
+    cv::add(result.color_votes, result.cvfh_votes, result.combined_votes);
 
-        std::cout << color_votes << std::endl;
-        std::cout << cvfh_votes << std::endl;
-        std::cout << combined_votes << std::endl;
+    for(int i = 0; i < objects; i++){
+        int color_column = highestVoteColumn(result.color_votes.row(i));
+        int cvfh_column = highestVoteColumn(result.cvfh_votes.row(i));
+        int combined_column = highestVoteColumn(result.combined_votes.row(i));
 
+        int color_prediction_result = classes.at<int>(0, color_column);
+        int cvfh_prediction_result = classes.at<int>(0, cvfh_column);
+        int combined_prediction_result = classes.at<int>(0, combined_column);
 
-        int color_highest_vote_amount = color_votes.at<int>(1, color_prediction_result);
-        int cvfh_highest_vote_amount = cvfh_votes.at<int>(1, cvfh_prediction_result);
-        int combined_prediction_result;
-        int combined_highest_vote_amount = 0;
-        for(int x = 0; x < combined_votes.cols; x++){ // Fill combined_prediction_result and combined_highest_vote_amount manually
-            if(combined_highest_vote_amount < combined_votes.at<int>(1, x)){
-                combined_prediction_result = x;
-                combined_highest_vote_amount = combined_votes.at<int>(1, x);
-            }
-        }
+        int color_highest_vote_amount = result.color_votes.at<int>(i, color_column);
+        int cvfh_highest_vote_amount = result.cvfh_votes.at<int>(i, cvfh_column);
+        int combined_highest_vote_amount = result.combined_votes.at<int>(i, combined_column);
 
         int color_vote_percentage = color_highest_vote_amount * 2;
         int cvfh_vote_percentage = cvfh_highest_vote_amount * 2;
 
+        ROS_INFO("Object %d:", i);
         ROS_INFO("Color: %d percent of votes for %s", color_vote_percentage, labels[color_prediction_result].c_str());
         ROS_INFO("CVFH: %d percent of votes for %s", cvfh_vote_percentage, labels[cvfh_prediction_result].c_str());
         ROS_INFO("Combined: %d percent of votes for %s", combined_highest_vote_amount, labels[combined_prediction_result].c_str());
@@ -180,12 +204,25 @@ std::string classifier::classify(std::vector<uint64_t> color_features, std::vect
             ROS_INFO("This is either a %s, or not an object in our dataset.", labels[combined_prediction_result].c_str());
         }
 
-        return labels[combined_prediction_result];
+        result.labels.push_back(labels[combined_prediction_result]);
     }
-    else{
-        ROS_ERROR("ERROR: Classifier hasn't been trained, or something went wrong while training!");
-        return "";
+    return true;
+}
+
+/**
+ * Finds the class with the most votes. On a tie the first one wins, like in RTrees::predict().
+ * @param votes: One row of votes (CV_32SC1)
+ * @return Column of the highest vote
+ */
+int classifier::highestVoteColumn(const cv::Mat &votes) {
+    const int *row = votes.ptr<int>(0);
+    int highest_column = 0;
+    for(int x = 1; x < votes.cols; x++){
+        if(row[x] > row[highest_column]){
+            highest_column = x;
+        }
     }
+    return highest_column;
 }
 
 /**
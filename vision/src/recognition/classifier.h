@@ -16,6 +16,17 @@
 
 using namespace cv; // OpenCV API is in the C++ "cv" namespace
 
+/**
+ * Result of classifying many objects at once. Row i of the votes belongs to object i,
+ * column j counts the trees that voted for label j.
+ */
+struct BatchClassification {
+    std::vector<std::string> labels;
+    cv::Mat color_votes;
+    cv::Mat cvfh_votes;
+    cv::Mat combined_votes;
+};
+
 class classifier {
 private:
     Ptr<cv::ml::RTrees> random_trees_color_classifier;
@@ -44,6 +55,8 @@ public:
     classifier();
     bool train(std::string directory, bool update);
     std::string classify(std::vector<uint64_t> color_features, std::vector<float> cvfh_features);
+    bool classifyBatch(cv::Mat &color_features, cv::Mat &cvfh_features, BatchClassification &result);
+    static int highestVoteColumn(const cv::Mat &votes);
     bool has_suffix(std::string s, std::string suffix);
     std::vector<float> read_from_file(std::string full_path, std::vector<float> parsedCsv);
 
@@ -0,0 +1,241 @@
+#include <pcl/io/pcd_io.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <vision_suturo_msgs/objects.h>
+#include <vision_suturo_msgs/poses.h>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Replays recorded PCD frames into the vision node and measures how fast its services answer.
+ * The frames of ~directory ending with ~suffix are loaded once, then published on ~topic with ~rate Hz, looping at the end.
+ * ~clients threads call objects_information and objects_poses for every found object:
+ *  - closed loop with ~qps 0: every client sends its next request as soon as the last one returned
+ *  - fixed rate with ~qps > 0: requests are due every 1/qps seconds, latencies count from the due time,
+ *    so a node that falls behind shows up in the latencies instead of lowering the request rate
+ * After ~requests requests the throughput and the p50/p95/p99 latencies are printed.
+ * objects_poses asks for an object of the last objects_information call of any client, so ~call_poses
+ * only works with a single client. Several clients measure objects_information alone.
+ *
+ * Usage: roslaunch vision_suturo replay.launch directory:=<path/to/pcds>
+ */
+
+std::vector<sensor_msgs::PointCloud2Ptr> frames;
+std::string frame_id;
+double rate;
+
+int requests;
+double qps;
+bool call_poses;
+ros::Time start_time;
+
+int next_request = 0;
+int failed_requests = 0;
+std::vector<double> objects_latencies; // seconds
+std::vector<double> poses_latencies;   // seconds, all objects of a request together
+std::vector<double> total_latencies;   // seconds, from the due time to the last pose
+boost::mutex results_mutex;            // guards next_request, failed_requests and the latencies
+
+/**
+ * Loads the PCD files of a directory in the order of their names.
+ * The fields are kept as they are, so the node gets the same cloud as from the kinect.
+ * @param directory
+ * @param suffix only files ending with it are loaded, e.g. "_kinect.pcd" for a dump of the flight recorder
+ * @return false if there's no frame
+ */
+bool loadFrames(const std::string &directory, const std::string &suffix) {
+    std::vector<std::string> files;
+    try {
+        for (boost::filesystem::directory_iterator it(directory), end; it != end; ++it) {
+            if (boost::algorithm::ends_with(it->path().filename().string(), suffix)) {
+                files.push_back(it->path().string());
+            }
+        }
+    } catch (boost::filesystem::filesystem_error e) {
+        ROS_ERROR("Replay: %s", e.what());
+        return false;
+    }
+    std::sort(files.begin(), files.end());
+
+    pcl::PCDReader reader;
+    for (size_t i = 0; i < files.size(); i++) {
+        pcl::PCLPointCloud2 cloud;
+        if (reader.read(files[i], cloud) < 0) {
+            ROS_WARN("Replay: couldn't read %s", files[i].c_str());
+            continue;
+        }
+        sensor_msgs::PointCloud2Ptr frame(new sensor_msgs::PointCloud2);
+        pcl_conversions::fromPCL(cloud, *frame);
+        frames.push_back(frame);
+    }
+    ROS_INFO("Replay: %lu frames loaded from %s", frames.size(), directory.c_str());
+    return !frames.empty();
+}
+
+/**
+ * Publishes the frames one after another, stamped with the current time.
+ */
+void publishFrames(ros::Publisher publisher) {
+    ros::Rate loop_rate(rate);
+    for (size_t i = 0; ros::ok(); i = (i + 1) % frames.size()) {
+        // A published message must not be changed, so every frame is sent as a new one
+        sensor_msgs::PointCloud2Ptr frame(new sensor_msgs::PointCloud2(*frames[i]));
+        frame->header.stamp = ros::Time::now();
+        frame->header.frame_id = frame_id;
+        publisher.publish(frame);
+        loop_rate.sleep();
+    }
+}
+
+/**
+ * Calls a service over a persistent connection. The connection breaks when a call fails or the node restarts,
+ * so the client is created again if it isn't valid anymore. Otherwise every later call would fail as well.
+ * @param client persistent client, replaced if it isn't valid
+ * @param name of the service
+ * @param service request and response
+ * @return false if the call failed
+ */
+template<typename Service>
+bool callService(ros::NodeHandle &n, ros::ServiceClient &client, const std::string &name, Service &service) {
+    if (!client.isValid()) {
+        client = n.serviceClient<Service>(name, true);
+    }
+    return client.call(service);
+}
+
+/**
+ * Client thread, sends requests until all are done.
+ */
+void runClient() {
+    ros::NodeHandle n;
+    ros::ServiceClient objects_client, poses_client; // connected by the first call
+
+    while (ros::ok()) {
+        int request;
+        {
+            boost::mutex::scoped_lock lock(results_mutex);
+            if (next_request >= requests) {
+                return;
+            }
+            request = next_request++;
+        }
+
+        ros::Time due = ros::Time::now();
+        if (qps > 0.0) {
+            due = start_time + ros::Duration(request / qps);
+            ros::Time::sleepUntil(due);
+        }
+
+        vision_suturo_msgs::objects objects;
+        bool success = callService(n, objects_client, "vision_suturo/objects_information", objects);
+        ros::Time objects_done = ros::Time::now();
+
+        for (int i = 0; success && call_poses && i < objects.response.clouds.object_amount; i++) {
+            vision_suturo_msgs::poses poses;
+            poses.request.index = i;
+            if (i < objects.response.clouds.labels.size()) {
+                poses.request.labels = objects.response.clouds.labels[i];
+            }
+            success = callService(n, poses_client, "vision_suturo/objects_poses", poses);
+        }
+        ros::Time poses_done = ros::Time::now();
+
+        boost::mutex::scoped_lock lock(results_mutex);
+        if (!success) {
+            failed_requests++;
+            continue;
+        }
+        objects_latencies.push_back((objects_done - due).toSec());
+        poses_latencies.push_back((poses_done - objects_done).toSec());
+        total_latencies.push_back((poses_done - due).toSec());
+    }
+}
+
+/**
+ * @param sorted latencies in seconds
+ * @param percentile between 0 and 100
+ * @return The latency in milliseconds, nearest rank
+ */
+double percentile(const std::vector<double> &sorted, double percentile) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = (size_t) (percentile / 100.0 * sorted.size() + 0.5);
+    return sorted[std::min(std::max(rank, (size_t) 1), sorted.size()) - 1] * 1000.0;
+}
+
+void report(const std::string &name, std::vector<double> latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-8s p50 %8.1f ms  p95 %8.1f ms  p99 %8.1f ms\n", name.c_str(), percentile(latencies, 50),
+           percentile(latencies, 95), percentile(latencies, 99));
+}
+
+int main(int argc, char **argv) {
+    ros::init(argc, argv, "vision_replay");
+    ros::NodeHandle n;
+    ros::NodeHandle n_private("~");
+
+    std::string directory, suffix, topic;
+    int clients;
+    n_private.param<std::string>("directory", directory, ".");
+    n_private.param<std::string>("suffix", suffix, ".pcd");
+    n_private.param<std::string>("topic", topic, "/cloud_pcd");
+    n_private.param<std::string>("frame_id", frame_id, "head_mount_kinect_rgb_optical_frame");
+    n_private.param("rate", rate, 10.0);
+    n_private.param("requests", requests, 100);
+    n_private.param("clients", clients, 1);
+    n_private.param("qps", qps, 0.0); // 0 = closed loop
+    n_private.param("call_poses", call_poses, true);
+
+    if (clients > 1 && call_poses) {
+        ROS_ERROR("Replay: the clients would overwrite each other's objects, use call_poses:=false with %d clients",
+                  clients);
+        return 1;
+    }
+
+    if (!loadFrames(directory, suffix)) {
+        ROS_ERROR("Replay: no PCD files in %s", directory.c_str());
+        return 1;
+    }
+
+    ros::Publisher publisher = n.advertise<sensor_msgs::PointCloud2>(topic, 1);
+    boost::thread publisher_thread(&publishFrames, publisher);
+
+    ROS_INFO("Replay: waiting for the vision node");
+    if (!ros::service::waitForService("vision_suturo/objects_information", ros::Duration(60.0))) {
+        ROS_ERROR("Replay: vision_suturo/objects_information isn't available");
+        ros::shutdown();
+        publisher_thread.join();
+        return 1;
+    }
+    ros::Duration(1.0).sleep(); // let the node receive the first frames
+
+    ROS_INFO("Replay: %d requests, %d clients, %s", requests, clients, qps > 0.0 ? "fixed rate" : "closed loop");
+    start_time = ros::Time::now();
+    boost::thread_group client_threads;
+    for (int i = 0; i < std::max(clients, 1); i++) {
+        client_threads.create_thread(&runClient);
+    }
+    client_threads.join_all();
+    double elapsed = (ros::Time::now() - start_time).toSec();
+
+    printf("requests %lu, failed %d, %.1f s, %.2f requests/s\n", total_latencies.size(), failed_requests, elapsed,
+           total_latencies.size() / elapsed);
+    report("objects", objects_latencies);
+    if (call_poses) {
+        report("poses", poses_latencies);
+    }
+    report("total", total_latencies);
+
+    ros::shutdown();
+    publisher_thread.join();
+    return 0;
+}
@@ -0,0 +1,241 @@
+#include "flight_recorder.h"
+#include "saving.h"
+
+#include <pcl/io/pcd_io.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <boost/filesystem.hpp>
+
+#include <iomanip>
+#include <sstream>
+
+boost::shared_ptr<FlightRecorder> flight_recorder;
+
+/**
+ * @param directory dumps are saved in a new folder inside it, ending with a slash
+ * @param max_frames frames that are kept, older ones are forgotten
+ * @param max_bytes memory the kept clouds may use, the oldest frames are forgotten first
+ */
+FlightRecorder::FlightRecorder(const std::string &directory, size_t max_frames, size_t max_bytes)
+        : directory_(directory), max_frames_(max_frames), max_bytes_(max_bytes), bytes_(0), dumps_(0),
+          dump_requested_(false), stop_(false) {
+    thread_ = boost::thread(&FlightRecorder::run, this);
+}
+
+FlightRecorder::~FlightRecorder() {
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    thread_.join();
+}
+
+/**
+ * Records a kinect message as it arrives, whether the pipeline runs on it or not.
+ * @param kinect message of the frame, kept as it is
+ */
+void FlightRecorder::recordFrame(const sensor_msgs::PointCloud2ConstPtr &kinect) {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!records_.empty() && records_.back().kinect == kinect) {
+        return;
+    }
+    pushRecord(kinect);
+}
+
+/**
+ * Starts recording the stages of a frame the pipeline runs on. The stages added afterwards belong to it.
+ * If the frame has been recorded before, its stages are replaced, otherwise it is recorded now.
+ * @param kinect message of the frame, kept as it is
+ */
+void FlightRecorder::beginFrame(const sensor_msgs::PointCloud2ConstPtr &kinect) {
+    boost::mutex::scoped_lock lock(mutex_);
+    current_ = kinect;
+    Record *record = findRecord(kinect);
+    if (record == NULL) {
+        pushRecord(kinect);
+        return;
+    }
+    bytes_ -= record->bytes - kinect->data.size();
+    record->bytes = kinect->data.size();
+    record->stage_names.clear();
+    record->stages.clear();
+}
+
+/**
+ * Adds the cloud of a pipeline stage to the frame of the last beginFrame().
+ * @param name of the stage
+ * @param cloud must not be changed afterwards
+ */
+void FlightRecorder::addStage(const std::string &name,
+                              const pcl::PointCloud<pcl::PointXYZRGBNormal>::ConstPtr &cloud) {
+    const size_t bytes = cloud->points.size() * sizeof(pcl::PointXYZRGBNormal);
+
+    boost::mutex::scoped_lock lock(mutex_);
+    Record *record = findRecord(current_);
+    if (record == NULL) {
+        return;
+    }
+    record->stage_names.push_back(name);
+    record->stages.push_back(cloud);
+    record->bytes += bytes;
+    bytes_ += bytes;
+    evict();
+}
+
+/**
+ * Appends a new record and forgets old ones if needed. The caller holds mutex_.
+ */
+void FlightRecorder::pushRecord(const sensor_msgs::PointCloud2ConstPtr &kinect) {
+    Record record;
+    record.stamp = kinect->header.stamp;
+    record.kinect = kinect;
+    record.bytes = kinect->data.size();
+    records_.push_back(record);
+    bytes_ += record.bytes;
+    evict();
+}
+
+/**
+ * @return The record of the kinect message, NULL if it isn't recorded. The caller holds mutex_.
+ */
+FlightRecorder::Record *FlightRecorder::findRecord(const sensor_msgs::PointCloud2ConstPtr &kinect) {
+    if (!kinect) {
+        return NULL;
+    }
+    // The frame the pipeline works on is usually one of the newest
+    for (std::deque<Record>::reverse_iterator record = records_.rbegin(); record != records_.rend(); ++record) {
+        if (record->kinect == kinect) {
+            return &*record;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Forgets the oldest frames until the limits are met. The newest frame and the one the pipeline
+ * is working on are always kept.
+ */
+void FlightRecorder::evict() {
+    while (records_.size() > 1 && (records_.size() > max_frames_ || bytes_ > max_bytes_)) {
+        std::deque<Record>::iterator oldest = records_.begin();
+        if (oldest->kinect == current_) {
+            ++oldest;
+        }
+        if (oldest + 1 == records_.end()) {
+            return;
+        }
+        bytes_ -= oldest->bytes;
+        records_.erase(oldest);
+    }
+}
+
+/**
+ * Saves all recorded frames as binary compressed PCD files into a new folder.
+ * The kinect frames are saved as they were received, the stages with normals.
+ * @param reason is logged
+ * @return The folder, empty if nothing was saved
+ */
+std::string FlightRecorder::dump(const std::string &reason) {
+    std::deque<Record> records;
+    size_t number;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        records = records_;
+        number = dumps_++;
+    }
+    if (records.empty()) {
+        ROS_WARN("Flight recorder: nothing recorded to dump");
+        return "";
+    }
+
+    std::stringstream folder_stream;
+    folder_stream << directory_ << "flight_recorder_" << getTime() << "_" << number << "/";
+    std::string folder = folder_stream.str();
+    ROS_INFO("Flight recorder: dumping %lu frames to %s (%s)", records.size(), folder.c_str(), reason.c_str());
+    try {
+        boost::filesystem::create_directories(folder);
+        pcl::PCDWriter writer;
+        for (size_t i = 0; i < records.size(); i++) {
+            std::stringstream prefix;
+            prefix << folder << records[i].stamp.sec << "." << std::setw(9) << std::setfill('0')
+                   << records[i].stamp.nsec << "_";
+
+            pcl::PCLPointCloud2 kinect;
+            pcl_conversions::toPCL(*records[i].kinect, kinect);
+            writer.writeBinaryCompressed(prefix.str() + "kinect.pcd", kinect);
+            for (size_t s = 0; s < records[i].stages.size(); s++) {
+                writer.writeBinaryCompressed(prefix.str() + records[i].stage_names[s] + ".pcd",
+                                             *records[i].stages[s]);
+            }
+        }
+    } catch (const pcl::PCLException &e) {
+        ROS_ERROR("Flight recorder: dump failed: %s", e.what());
+        return "";
+    } catch (const boost::filesystem::filesystem_error &e) {
+        ROS_ERROR("Flight recorder: dump failed: %s", e.what());
+        return "";
+    }
+    return folder;
+}
+
+/**
+ * Asks for a dump without waiting for it, e.g. when the pipeline failed.
+ * @param reason is logged
+ * @param min_interval seconds since the last requested dump, requests that come earlier are ignored
+ */
+void FlightRecorder::requestDump(const std::string &reason, double min_interval) {
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        ros::Time now = ros::Time::now();
+        if (dump_requested_ || (!last_requested_dump_.isZero() &&
+                                (now - last_requested_dump_).toSec() < min_interval)) {
+            return;
+        }
+        last_requested_dump_ = now;
+        dump_requested_ = true;
+        dump_reason_ = reason;
+    }
+    condition_.notify_all();
+}
+
+/**
+ * Dump thread, writes the requested dumps.
+ */
+void FlightRecorder::run() {
+    while (true) {
+        std::string reason;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            while (!dump_requested_ && !stop_) {
+                condition_.wait(lock);
+            }
+            if (stop_) {
+                return;
+            }
+            reason = dump_reason_;
+        }
+        dump(reason);
+        boost::mutex::scoped_lock lock(mutex_);
+        dump_requested_ = false;
+    }
+}
+
+/**
+ * Hands the cloud of a pipeline stage to the snapshot writer and the flight recorder.
+ * The kinect stage isn't recorded, the flight recorder keeps the kinect message instead.
+ * @param stage the cloud belongs to
+ * @param cloud must not be changed afterwards
+ * @param name used for the files
+ */
+void recordStage(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &cloud,
+                 const std::string &name) {
+    saveSnapshot(stage, cloud, name);
+}
+
+void recordStage(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGBNormal>::ConstPtr &cloud,
+                 const std::string &name) {
+    saveSnapshot(stage, cloud, name);
+    if (flight_recorder) {
+        flight_recorder->addStage(name, cloud);
+    }
+}
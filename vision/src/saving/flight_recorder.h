@@ -0,0 +1,77 @@
+#ifndef VISION_FLIGHT_RECORDER_H
+#define VISION_FLIGHT_RECORDER_H
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "snapshot_writer.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * Keeps the last frames of the kinect and the clouds of the pipeline stages computed from them in memory,
+ * so they can be saved when something went wrong. Every received frame is recorded, the stages are
+ * attached to the frames the pipeline ran on. Recording only stores shared pointers, it never copies
+ * a cloud and never touches the disk. The memory is bounded by a number of frames and a number of bytes.
+ */
+class FlightRecorder {
+public:
+    /** One kinect frame and the stages computed from it. **/
+    struct Record {
+        ros::Time stamp; // capture time of the frame
+        sensor_msgs::PointCloud2ConstPtr kinect;
+        std::vector<std::string> stage_names;
+        std::vector<pcl::PointCloud<pcl::PointXYZRGBNormal>::ConstPtr> stages;
+        size_t bytes;
+    };
+
+    FlightRecorder(const std::string &directory, size_t max_frames, size_t max_bytes);
+    ~FlightRecorder();
+
+    void recordFrame(const sensor_msgs::PointCloud2ConstPtr &kinect);
+    void beginFrame(const sensor_msgs::PointCloud2ConstPtr &kinect);
+    void addStage(const std::string &name, const pcl::PointCloud<pcl::PointXYZRGBNormal>::ConstPtr &cloud);
+    std::string dump(const std::string &reason);
+    void requestDump(const std::string &reason, double min_interval);
+
+private:
+    void pushRecord(const sensor_msgs::PointCloud2ConstPtr &kinect);
+    Record *findRecord(const sensor_msgs::PointCloud2ConstPtr &kinect);
+    void evict();
+    void run();
+
+    std::string directory_;
+    size_t max_frames_;
+    size_t max_bytes_;
+
+    std::deque<Record> records_;
+    size_t bytes_;
+    sensor_msgs::PointCloud2ConstPtr current_; // frame the pipeline is working on, gets the stages
+    size_t dumps_; // numbers the dump folders, so dumps of the same second don't overwrite each other
+    boost::mutex mutex_;
+
+    // Dumps requested by failures are written by this thread
+    std::string dump_reason_;
+    bool dump_requested_;
+    ros::Time last_requested_dump_;
+    bool stop_;
+    boost::condition_variable condition_;
+    boost::thread thread_;
+};
+
+void recordStage(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &cloud,
+                 const std::string &name);
+void recordStage(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGBNormal>::ConstPtr &cloud,
+                 const std::string &name);
+
+extern boost::shared_ptr<FlightRecorder> flight_recorder; // created by the node, nothing is recorded without it
+
+#endif //VISION_FLIGHT_RECORDER_H
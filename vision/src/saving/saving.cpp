@@ -35,6 +35,23 @@ void savePointCloudRGBNamed(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud, std::s
 
 }
 
+void savePointCloudRGBNormalNamed(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud, std::string filename) {
+    try {
+        ROS_INFO("Saving PointCloud<PointXYZRGBNormal>");
+        std::string time_string = getTime();
+
+        std::stringstream ss;
+
+        // automatic save to $HOME/.ros folder
+
+        ss << "../../../src/vision_suturo_1718/vision/data/" << filename << "_" << time_string << ".pcd";
+        pcl::io::savePCDFileASCII(ss.str(), *cloud);
+    } catch (pcl::PCLException e) {
+        ROS_ERROR("Saving failed: %s", e.what());
+    }
+
+}
+
 void savePointCloudXYZ(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud) {
     try {
         ROS_INFO("Saving PointCloud<PointXYZ>");
@@ -18,6 +18,9 @@ std::string getTime();
 void savePointCloudRGBNamed(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud,
                             std::string filename);
 
+void savePointCloudRGBNormalNamed(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud,
+                                  std::string filename);
+
 void savePointCloudXYZ(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud);
 
 void savePointCloudXYZNamed(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud, std::string filename);
@@ -0,0 +1,180 @@
+#include "snapshot_writer.h"
+#include "saving.h"
+
+#include <iomanip>
+#include <sstream>
+
+boost::shared_ptr<SnapshotWriter> snapshot_writer;
+
+static const char *STAGE_NAMES[SNAPSHOT_STAGE_COUNT] = {"kinect", "preprocessed", "above_plane", "final", "objects"};
+
+/**
+ * Starts the writer thread. All stages are enabled.
+ * @param directory to save the files in, ending with a slash
+ * @param format binary or binary compressed PCD
+ * @param max_queued clouds that may wait for the disk, more are dropped
+ */
+SnapshotWriter::SnapshotWriter(const std::string &directory, SnapshotFormat format, size_t max_queued)
+        : directory_(directory), format_(format), max_queued_(max_queued), frames_(0), dropped_(0), stop_(false) {
+    for (int i = 0; i < SNAPSHOT_STAGE_COUNT; i++) {
+        stage_enabled_[i] = true;
+    }
+    thread_ = boost::thread(&SnapshotWriter::run, this);
+}
+
+/**
+ * Saves the clouds that are still queued and stops the writer thread.
+ */
+SnapshotWriter::~SnapshotWriter() {
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    thread_.join();
+}
+
+/**
+ * Enables or disables saving the clouds of a stage. Set up before the writer is used.
+ */
+void SnapshotWriter::setStageEnabled(SnapshotStage stage, bool enabled) {
+    stage_enabled_[stage] = enabled;
+}
+
+bool SnapshotWriter::isStageEnabled(SnapshotStage stage) const {
+    return stage_enabled_[stage];
+}
+
+/**
+ * Starts a new frame. The clouds saved afterwards get its stamp and the number of the run in their
+ * file names, so frames of the same second don't overwrite each other, even if a frame is processed twice.
+ * @param stamp capture time of the kinect frame
+ */
+void SnapshotWriter::beginFrame(const ros::Time &stamp) {
+    boost::mutex::scoped_lock lock(mutex_);
+    std::stringstream suffix;
+    suffix << "_" << stamp.sec << "." << std::setw(9) << std::setfill('0') << stamp.nsec << "_" << frames_++;
+    frame_suffix_ = suffix.str();
+}
+
+/**
+ * Queues a cloud to be saved as <filename>_<time>_<frame stamp>_<run>.pcd.
+ * @param stage the cloud belongs to, nothing is saved if it's disabled
+ * @param cloud must not be changed afterwards
+ * @param filename without directory and extension
+ * @return false if the cloud isn't saved
+ */
+bool SnapshotWriter::save(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &cloud,
+                          const std::string &filename) {
+    Job job;
+    job.rgb = cloud;
+    return enqueue(stage, job, filename);
+}
+
+bool SnapshotWriter::save(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGBNormal>::ConstPtr &cloud,
+                          const std::string &filename) {
+    Job job;
+    job.rgb_normal = cloud;
+    return enqueue(stage, job, filename);
+}
+
+/**
+ * @return Number of clouds dropped because the queue was full
+ */
+size_t SnapshotWriter::getDropped() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return dropped_;
+}
+
+/**
+ * @param name of a stage, e.g. "above_plane"
+ * @param stage returns the stage
+ * @return false if there's no stage with that name
+ */
+bool SnapshotWriter::parseStage(const std::string &name, SnapshotStage &stage) {
+    for (int i = 0; i < SNAPSHOT_STAGE_COUNT; i++) {
+        if (name == STAGE_NAMES[i]) {
+            stage = static_cast<SnapshotStage>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SnapshotWriter::enqueue(SnapshotStage stage, Job &job, const std::string &filename) {
+    if (!stage_enabled_[stage]) {
+        return false;
+    }
+    const std::string time = getTime();
+
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        job.path = directory_ + filename + "_" + time + frame_suffix_ + ".pcd";
+        if (queue_.size() >= max_queued_) {
+            dropped_++;
+            ROS_WARN_THROTTLE(1.0, "Snapshot writer is busy, dropped %s (%lu dropped so far)", filename.c_str(),
+                              dropped_);
+            return false;
+        }
+        queue_.push_back(job);
+    }
+    condition_.notify_one();
+    return true;
+}
+
+/**
+ * Writer thread. Saves the queued clouds until the writer is destroyed and the queue is empty.
+ */
+void SnapshotWriter::run() {
+    pcl::PCDWriter writer;
+    while (true) {
+        Job job;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            while (queue_.empty() && !stop_) {
+                condition_.wait(lock);
+            }
+            if (queue_.empty()) {
+                return;
+            }
+            job = queue_.front();
+            queue_.pop_front();
+        }
+
+        try {
+            int error;
+            if (job.rgb) {
+                error = format_ == SNAPSHOT_BINARY_COMPRESSED ? writer.writeBinaryCompressed(job.path, *job.rgb)
+                                                              : writer.writeBinary(job.path, *job.rgb);
+            } else {
+                error = format_ == SNAPSHOT_BINARY_COMPRESSED ? writer.writeBinaryCompressed(job.path, *job.rgb_normal)
+                                                              : writer.writeBinary(job.path, *job.rgb_normal);
+            }
+            if (error < 0) {
+                ROS_ERROR("Saving %s failed", job.path.c_str());
+            }
+        } catch (const pcl::PCLException &e) {
+            ROS_ERROR("Saving failed: %s", e.what());
+        }
+    }
+}
+
+/**
+ * Saves a cloud with the snapshot writer of the node, if there is one.
+ * @param stage the cloud belongs to
+ * @param cloud must not be changed afterwards
+ * @param filename without directory and extension
+ */
+void saveSnapshot(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &cloud,
+                  const std::string &filename) {
+    if (snapshot_writer) {
+        snapshot_writer->save(stage, cloud, filename);
+    }
+}
+
+void saveSnapshot(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGBNormal>::ConstPtr &cloud,
+                  const std::string &filename) {
+    if (snapshot_writer) {
+        snapshot_writer->save(stage, cloud, filename);
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef VISION_SNAPSHOT_WRITER_H
+#define VISION_SNAPSHOT_WRITER_H
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <ros/time.h>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <deque>
+#include <string>
+
+/**
+ * Stages of the pipeline whose clouds can be saved.
+ */
+enum SnapshotStage {
+    SNAPSHOT_KINECT,        // raw kinect cloud
+    SNAPSHOT_PREPROCESSED,  // after crop, voxel grid and MLS
+    SNAPSHOT_ABOVE_PLANE,   // points above the table
+    SNAPSHOT_FINAL,         // all object points
+    SNAPSHOT_OBJECTS,       // one cloud per object
+    SNAPSHOT_STAGE_COUNT
+};
+
+enum SnapshotFormat {
+    SNAPSHOT_BINARY,
+    SNAPSHOT_BINARY_COMPRESSED
+};
+
+/**
+ * Saves PointClouds as PCD files on its own thread, so the services never wait for the disk.
+ * The clouds are queued as shared pointers and must not be changed after they were handed over.
+ * If the queue is full, new clouds are dropped instead of waiting.
+ */
+class SnapshotWriter {
+public:
+    SnapshotWriter(const std::string &directory, SnapshotFormat format, size_t max_queued);
+    ~SnapshotWriter();
+
+    void setStageEnabled(SnapshotStage stage, bool enabled);
+    bool isStageEnabled(SnapshotStage stage) const;
+    void beginFrame(const ros::Time &stamp);
+    bool save(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &cloud,
+              const std::string &filename);
+    bool save(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGBNormal>::ConstPtr &cloud,
+              const std::string &filename);
+    size_t getDropped();
+
+    static bool parseStage(const std::string &name, SnapshotStage &stage);
+
+private:
+    /** One cloud to save, only one of the pointers is set. **/
+    struct Job {
+        pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr rgb;
+        pcl::PointCloud<pcl::PointXYZRGBNormal>::ConstPtr rgb_normal;
+        std::string path;
+    };
+
+    bool enqueue(SnapshotStage stage, Job &job, const std::string &filename);
+    void run();
+
+    std::string directory_;
+    SnapshotFormat format_;
+    size_t max_queued_;
+    bool stage_enabled_[SNAPSHOT_STAGE_COUNT];
+    std::string frame_suffix_; // stamp and run of the current frame, keeps the file names unique
+    size_t frames_;
+
+    std::deque<Job> queue_;
+    size_t dropped_;
+    bool stop_;
+    boost::mutex mutex_;
+    boost::condition_variable condition_;
+    boost::thread thread_;
+};
+
+void saveSnapshot(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &cloud,
+                  const std::string &filename);
+void saveSnapshot(SnapshotStage stage, const pcl::PointCloud<pcl::PointXYZRGBNormal>::ConstPtr &cloud,
+                  const std::string &filename);
+
+extern boost::shared_ptr<SnapshotWriter> snapshot_writer; // created by the node, no snapshots without it
+
+#endif //VISION_SNAPSHOT_WRITER_H
@@ -0,0 +1,98 @@
+#include "../src/perception/perception.h"
+
+#include <pcl/common/transforms.h>
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+
+/**
+ * Aligns moved copies of the meshes to the meshes themselves with globalAlignment().
+ * The copies are seen like the kinect sees an object: only the side facing the camera,
+ * with the normals of the MLS filter. If the normals of the meshes and the scene point in
+ * different directions, their FPFH features don't match and the alignment fails.
+ */
+
+// A bottle, a carton and a box
+const char *MESH_LABELS[] = {"HelaCurryKetchup", "JaMilch", "KoellnMuesliKnusperHonigNuss"};
+
+// m^2, mean squared distance of an aligned copy. The global alignment is only rough, ICP refines it.
+const double MAX_FITNESS = 0.01 * 0.01;
+
+class GlobalAlignmentTest : public ::testing::Test {
+protected:
+    static void SetUpTestCase() {
+        ModelRegistryConfig config = perception_params.modelRegistryConfig();
+        config.compute_features = true;
+        registry = new ModelRegistry;
+        registry->load(MESH_DIRECTORY, config);
+    }
+
+    static void TearDownTestCase() {
+        delete registry;
+        registry = NULL;
+    }
+
+    static ModelRegistry *registry;
+};
+
+ModelRegistry *GlobalAlignmentTest::registry = NULL;
+
+/**
+ * @param offset moves the mesh in front of the camera
+ * @return The side of the moved mesh facing the camera at the origin, with MLS normals
+ */
+PointCloudRGBNormalPtr seenByCamera(const ObjectModel &model, const Eigen::Matrix4f &offset) {
+    PointCloudRGBNormalPtr moved(new PointCloudRGBNormal);
+    pcl::transformPointCloudWithNormals(*model.cloud, *moved, offset);
+    PointCloudRGBPtr visible(new PointCloudRGB);
+    for (size_t i = 0; i < moved->points.size(); i++) {
+        const pcl::PointXYZRGBNormal &point = moved->points[i];
+        if (point.getNormalVector3fMap().dot(point.getVector3fMap()) < 0.0f) {
+            pcl::PointXYZRGB visible_point;
+            pcl::copyPoint(point, visible_point);
+            visible->points.push_back(visible_point);
+        }
+    }
+    visible->width = visible->points.size();
+    visible->height = 1;
+    return mlsFilter(voxelGridFilter(visible, perception_params.core.voxel_leaf_size), perception_params.core);
+}
+
+/**
+ * @return Mean squared distance from every point to the closest point of the mesh
+ */
+double fitnessOf(const PointCloudRGBNormal &cloud, const ObjectModel &model) {
+    std::vector<int> index(1);
+    std::vector<float> squared_distance(1);
+    double sum = 0.0;
+    for (size_t i = 0; i < cloud.points.size(); i++) {
+        model.trees.back()->nearestKSearch(cloud.points[i], 1, index, squared_distance);
+        sum += squared_distance[0];
+    }
+    return sum / cloud.points.size();
+}
+
+TEST_F(GlobalAlignmentTest, alignsMovedMeshToItself) {
+    srand(42); // the sample consensus draws with rand()
+    Eigen::Affine3f offset = Eigen::Affine3f::Identity();
+    offset.translate(Eigen::Vector3f(0.1f, -0.05f, 0.9f));
+    offset.rotate(Eigen::AngleAxisf(M_PI / 3.0f, Eigen::Vector3f(1.0f, 2.0f, 0.5f).normalized()));
+
+    for (size_t m = 0; m < sizeof(MESH_LABELS) / sizeof(MESH_LABELS[0]); m++) {
+        const ObjectModel *model = registry->get(MESH_LABELS[m]);
+        ASSERT_TRUE(model != NULL) << MESH_LABELS[m];
+        PointCloudRGBNormalPtr perceived = seenByCamera(*model, offset.matrix());
+
+        Eigen::Matrix4f transformation;
+        ASSERT_TRUE(globalAlignment(perceived, *model, transformation)) << model->file;
+
+        PointCloudRGBNormal aligned;
+        pcl::transformPointCloud(*perceived, aligned, transformation);
+        EXPECT_LT(fitnessOf(aligned, *model), MAX_FITNESS) << model->file;
+    }
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
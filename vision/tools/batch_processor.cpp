@@ -3,411 +3,327 @@
 //
 
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
-#include <pcl/PointIndices.h>
-#include <pcl_conversions/pcl_conversions.h>
-#include <pcl/segmentation/sac_segmentation.h>
-#include <pcl/search/kdtree.h>
-#include <pcl/filters/passthrough.h>
-#include <pcl/features/normal_3d.h>
-#include <pcl/surface/convex_hull.h>
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/segmentation/extract_clusters.h>
-#include <pcl/filters/extract_indices.h>
-#include <pcl/surface/mls.h>
-#include <pcl/filters/statistical_outlier_removal.h>
-#include <pcl/features/cvfh.h>
-#include <pcl/registration/icp.h>
-#include <pcl/registration/ia_ransac.h>
-#include <pcl/impl/point_types.hpp>
-#include <pcl/visualization/point_cloud_color_handlers.h>
-#include <sensor_msgs/PointCloud2.h>
-
-
-typedef pcl::PointCloud<pcl::PointXYZRGB>::Ptr PointCloudRGBPtr;
-typedef pcl::PointCloud<pcl::Normal>::Ptr PointCloudNormalPtr;
-typedef pcl::PointCloud<pcl::PointNormal>::Ptr PointCloudPointNormalPtr;
-typedef pcl::PointCloud<pcl::PointXYZRGB> PointCloudRGB;
-typedef pcl::PointCloud<pcl::Normal> PointCloudNormal;
-typedef pcl::PointIndices::Ptr PointIndices;
-typedef std::vector<pcl::PointIndices> PointIndicesVector;
-typedef std::vector<pcl::PointIndices::Ptr> PointIndicesVectorPtr;
-
-typedef pcl::PointCloud<pcl::VFHSignature308>::Ptr PointCloudVFHS308Ptr;
-typedef sensor_msgs::PointCloud2 SMSGSPointCloud2;
-
-PointCloudNormalPtr cloud_normals(new PointCloudNormal);
+#include <pcl/common/time.h>
+#include <pcl/io/pcd_io.h>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
 
-/**
- * estimating surface normals
- * @param input
- * @return
- */
-PointCloudNormalPtr estimateSurfaceNormals(PointCloudRGBPtr input) {
-
-    pcl::NormalEstimation<pcl::PointXYZRGB, pcl::Normal> ne;
-    ne.setInputCloud(input);
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree(
-            new pcl::search::KdTree<pcl::PointXYZRGB>());
-    ne.setSearchMethod(tree);
+#include "../src/perception/perception_core.h"
+#include "../src/parallel/worker_pool.h"
 
 
-    ne.setRadiusSearch(0.03); // Use all neighbors in a sphere of radius 3cm
-
-    ne.compute(*cloud_normals);
-
-    return cloud_normals;
+/**
+ * Parameters of the training data. The partial views are denser than the kinect clouds,
+ * so they keep a finer voxel grid and their own cluster limits.
+ */
+PerceptionCoreParams trainingParams(const ColorHistogramConfig &color_config, bool mls_normals, float normal_radius) {
+    PerceptionCoreParams params;
+    params.voxel_leaf_size = 0.0025f; // from 0.005 (perception)
+    params.min_cluster_size = 200;
+    params.max_cluster_size = 25000;
+    params.color_histogram = color_config;
+    params.cvfh_mls_normals = mls_normals;
+    params.normal_radius = normal_radius;
+    return params;
 }
 
 /**
  * estimate the Features of a pointcloud using VFHSignature308
- * @param input
- * @return
+ * @param input object, CVFH gets its normals like in the vision node
+ * @return the 308 bins, empty if there is no descriptor
  */
-std::vector<float> cvfhRecognition(PointCloudRGBPtr input) {
-    std::vector<float> result;
-    // Object for storing the normals.
-    pcl::PointCloud<pcl::Normal>::Ptr normals(new pcl::PointCloud<pcl::Normal>);
-    // Object for storing the CVFH descriptors.
-    pcl::PointCloud<pcl::VFHSignature308>::Ptr descriptors(new pcl::PointCloud<pcl::VFHSignature308>);
-
-    // Estimate the normals of the object.
-    normals = estimateSurfaceNormals(input);
-
-    // New KdTree to search with.
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr kdtree(new pcl::search::KdTree<pcl::PointXYZRGB>);
-
-    // CVFH estimation object.
-    pcl::CVFHEstimation<pcl::PointXYZRGB, pcl::Normal, pcl::VFHSignature308> cvfh;
-    cvfh.setInputCloud(input);
-    cvfh.setInputNormals(normals);
-    cvfh.setSearchMethod(kdtree);
-    cvfh.setEPSAngleThreshold(5.0 / 180.0 * M_PI);
-    cvfh.setCurvatureThreshold(1.0);
-    cvfh.setNormalizeBins(false);
-
-    cvfh.compute(*descriptors);
-
-    for (size_t i = 0; i < 308; i++){
-        result.push_back(descriptors->points[0].histogram[i]);
+std::vector<float> cvfhFeatures(PointCloudRGBNormalPtr input, const PerceptionCoreParams &params) {
+    SearchCache search_cache;
+    PointCloudVFHS308Ptr descriptors = cvfhRecognition(input, search_cache, params);
+    if (descriptors->empty()) {
+        return std::vector<float>();
     }
-
-    std::cout << "normals OK" << std::endl;
-
-    return result; // to vector
+    return std::vector<float>(descriptors->points[0].histogram, descriptors->points[0].histogram + 308);
 }
 
 /**
- * Color Histogram from RGBA-PointCloud
- * @param input
- * @return concatenated floats (r,g,b (in that order) from Pointcloud-Points
+ * @return the largest cluster of the input, the input itself if there is none
  */
-std::vector<uint64_t> produceColorHist(pcl::PointCloud<pcl::PointXYZRGB>::Ptr  cloud){
-    int red[8];
-    int green[8];
-    int blue[8];
-    std::vector<uint64_t> result;
-
-    // initialize all array-values with 0
-    for (int i = 0; i < 8;i++){
-        red[i] = 0;
-        green[i] = 0;
-        blue[i] = 0;
+PointCloudRGBNormalPtr largestCluster(PointCloudRGBNormalPtr input, const PerceptionCoreParams &params) {
+    SearchCache search_cache;
+    std::vector<PointCloudRGBNormalPtr> clusters = euclideanClusterExtraction(input, search_cache, params);
+    if (clusters.empty()) {
+        return input;
     }
+    return clusters[0];
+}
 
-    for (int i = 0; i <  cloud->size(); i++){
-        pcl::PointXYZRGB p = cloud->points[i];
-        // increase value in bin at given index
-        if (p.r < 32){
-            red[0]++;
-
-        } else if (p.r >= 32 && p.r < 64){
-            red[1]++;
-
-        } else if (p.r >= 64 && p.r < 96){
-            red[2]++;
-        } else if (p.r >= 96 && p.r < 128){
-            red[3]++;
 
-        } else if (p.r >= 128 && p.r < 160){
-            red[4]++;
+/**
+ * Version of the feature pipeline. Increase it when the filters or features change in a way
+ * the parameters don't show, so all files are processed again.
+ */
+const int FEATURE_VERSION = 1;
 
-        } else if (p.r >= 160 && p.r < 192){
-            red[5]++;
+enum FileResult {
+    FILE_PROCESSED,
+    FILE_SKIPPED,  // features are up to date
+    FILE_FAILED    // couldn't be loaded or has no features, empty features are saved
+};
 
-        } else if (p.r >= 192 && p.r < 224){
-            red[6]++;
+/**
+ * Saves empty .csv files for a file whose features couldn't be computed and forgets its stamp,
+ * so the file is processed again by the next run.
+ * @return FILE_FAILED
+ */
+FileResult failFile(const std::string &normals, const std::string &colors, const std::string &stamp_file) {
+    // save empty .csv
+    std::ofstream os_normals(normals.c_str());
+    std::ofstream os_colors(colors.c_str());
+    os_normals.close();
+    os_colors.close();
+    std::remove(stamp_file.c_str());
+    return FILE_FAILED;
+}
 
-        } else if (p.r >= 224 && p.r < 256){
-            red[7]++;
+/**
+ * Progress of a batch, shared by the worker threads.
+ */
+struct BatchProgress {
+    size_t total;
+    size_t done;
+    size_t results[3]; // per FileResult
+    pcl::StopWatch watch;
+    boost::mutex mutex;
+
+    BatchProgress() : total(0), done(0) {
+        results[FILE_PROCESSED] = results[FILE_SKIPPED] = results[FILE_FAILED] = 0;
+    }
+};
 
+/**
+ * FNV-1a hash of a file's content.
+ * @return false if the file can't be read
+ */
+bool hashFile(const std::string &path, uint64_t &hash) {
+    std::ifstream is(path.c_str(), std::ios::binary);
+    if (!is) {
+        return false;
+    }
+    hash = 14695981039346656037ULL;
+    char buffer[65536];
+    while (is.read(buffer, sizeof(buffer)) || is.gcount() > 0) {
+        for (std::streamsize i = 0; i < is.gcount(); i++) {
+            hash = (hash ^ (unsigned char) buffer[i]) * 1099511628211ULL;
         }
+    }
+    return true;
+}
 
-        if (p.g < 32){
-            green[0]++;
-
-        } else if (p.g >= 32 && p.g < 64){
-            green[1]++;
-
-        } else if (p.g >= 64 && p.g < 96){
-            green[2]++;
-        } else if (p.g >= 96 && p.g < 128){
-            green[3]++;
-
-        } else if (p.g >= 128 && p.g < 160){
-            green[4]++;
-
-        } else if (p.g >= 160 && p.g < 192){
-            green[5]++;
-
-        } else if (p.g >= 192 && p.g < 224){
-            green[6]++;
+/**
+ * Describes everything the features depend on besides the input file.
+ */
+std::string parameterVersion(const PerceptionCoreParams &params) {
+    std::stringstream version;
+    version << "v" << FEATURE_VERSION
+            << " leaf " << params.voxel_leaf_size
+            << " mls " << params.mls_polynomial_order << " " << params.mls_search_radius
+            << " normals " << params.normal_radius
+            << " cluster " << params.cluster_tolerance << " " << params.min_cluster_size << " " << params.max_cluster_size
+            << " cvfh " << params.cvfh_eps_angle << " " << params.cvfh_curvature_threshold << " " << params.cvfh_mls_normals
+            << " color " << params.color_histogram.bins << " " << params.color_histogram.color_space;
+    return version.str();
+}
 
-        } else if (p.g >= 224 && p.g < 256){
-            green[7]++;
+bool fileExists(const std::string &path) {
+    std::ifstream is(path.c_str());
+    return is.good();
+}
 
+/**
+ * Computes the features of one PCD file and saves them next to it, unless they are up to date.
+ * A stamp file remembers the hash of the PCD file and the parameters the features were computed with.
+ * Safe to call for several files at the same time.
+ * @param line path of the PCD file
+ * @param params filters and features
+ * @param force compute the features even if they are up to date
+ */
+FileResult processFile(std::string line, const PerceptionCoreParams &params, bool force) {
+    PointCloudRGBPtr input_cloud, input_sampler(new PointCloudRGB);
+    std::vector<float> input_cvfhs_features;
+    std::vector<uint64_t> input_color_features;
+
+    const std::string pcd_file = line;
+    line.erase(line.size() - 4, 4);
+    std::string normals = line + "_normals_histogram.csv";
+    std::string colors = line + "_colors_histogram.csv";
+    std::string stamp_file = line + "_features.stamp";
+
+    uint64_t hash = 0;
+    std::stringstream stamp;
+    if (hashFile(pcd_file, hash)) {
+        stamp << std::hex << hash << std::dec << " " << parameterVersion(params);
+        std::ifstream is(stamp_file.c_str());
+        std::string saved_stamp;
+        if (!force && std::getline(is, saved_stamp) && saved_stamp == stamp.str()
+            && fileExists(normals) && fileExists(colors)) {
+            return FILE_SKIPPED;
         }
+    }
 
-        if (p.b < 32){
-            blue[0]++;
-
-        } else if (p.b >= 32 && p.b < 64){
-            blue[1]++;
-
-        } else if (p.b >= 64 && p.b < 96){
-            blue[2]++;
-        } else if (p.b >= 96 && p.b < 128){
-            blue[3]++;
-
-        } else if (p.b >= 128 && p.b < 160){
-            blue[4]++;
-
-        } else if (p.b >= 160 && p.b < 192){
-            blue[5]++;
+    // load file
+    if (pcl::io::loadPCDFile<pcl::PointXYZRGB>(pcd_file, *input_sampler) != 0){
+        return failFile(normals, colors, stamp_file);
+    }
 
-        } else if (p.b >= 192 && p.b < 224){
-            blue[6]++;
+    //downsample partial view
+    input_cloud = voxelGridFilter(input_sampler, params.voxel_leaf_size);
 
-        } else if (p.b >= 224 && p.b < 256){
-            blue[7]++;
+    PointCloudRGBNormalPtr object_cloud = mlsFilter(input_cloud, params);
+    object_cloud = largestCluster(object_cloud, params);
 
-        }
+    // estimate features
+    input_cvfhs_features = cvfhFeatures(object_cloud, params);
+    input_color_features = produceColorHist(object_cloud, params);
+    if (input_cvfhs_features.empty() || input_color_features.empty()) {
+        return failFile(normals, colors, stamp_file);
     }
 
-    // concatenate red, green and blue entries
-    for (int r = 0; r < 8; r++){
-        result.push_back(red[r]);
-    }
-    for (int g = 0; g < 8; g++){
-        result.push_back(green[g]);
+    // save features to .csv
+    std::ofstream os_normals(normals.c_str());
+    std::ofstream os_colors(colors.c_str());
+    for (int i = 0; i < input_cvfhs_features.size(); i++) {
+        if (i == input_cvfhs_features.size() - 1) {
+            os_normals << input_cvfhs_features[i];
+        } else {
+            os_normals << input_cvfhs_features[i] << ", ";
+        }
     }
-    for (int b = 0; b < 8; b++){
-        result.push_back(blue[b]);
+    for (int j = 0; j < input_color_features.size(); j++) {
+        if (j == input_color_features.size()-1){
+            os_colors << input_color_features[j];
+        } else {
+            os_colors << input_color_features[j] << ", ";
+        }
     }
+    os_normals.close();
+    os_colors.close();
 
-    return result;
-
-}
-
-PointCloudRGBPtr mlsFilter(PointCloudRGBPtr input) {
-    PointCloudRGBPtr result(new PointCloudRGB);
-
-    int poly_ord = 1;
-
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZRGB>);
-    pcl::PointCloud<pcl::PointNormal> mls_points;
-    pcl::MovingLeastSquares<pcl::PointXYZRGB, pcl::PointNormal> mls;
-
-    mls.setComputeNormals(true);
-    mls.setInputCloud(input);
-    mls.setPolynomialOrder(poly_ord); // the lower the smoother, the higher the more exact
-    mls.setSearchMethod(tree);
-    mls.setSearchRadius(0.03);
-    mls.process(mls_points);
-
-    for (int i = 0; i < mls_points.size(); i++) {
-        pcl::PointXYZRGB point;
-
-        point.x = mls_points.points[i].x;
-        point.y = mls_points.points[i].y;
-        point.z = mls_points.points[i].z;
-        point.r = input->points[i].r;
-        point.g = input->points[i].g;
-        point.b = input->points[i].b;
-        point.rgb = input->points[i].rgb;
-        point.rgba = input->points[i].rgba;
-        result->push_back(point);
+    // Only remember the features once they are saved completely
+    if (os_normals && os_colors && hash != 0) {
+        std::ofstream os_stamp(stamp_file.c_str());
+        os_stamp << stamp.str() << std::endl;
     }
-    return result;
+    return FILE_PROCESSED;
 }
 
-PointCloudRGBPtr euclideanClusterExtraction(PointCloudRGBPtr input) {
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZRGB>);
-    tree->setInputCloud(input);
-
-    PointIndicesVector cluster_indices;
-    pcl::EuclideanClusterExtraction<pcl::PointXYZRGB> ec;
-    ec.setClusterTolerance(0.01);
-    ec.setMinClusterSize(200);
-    ec.setMaxClusterSize(25000);
-    ec.setSearchMethod(tree);
-    ec.setInputCloud(input);
-    ec.extract(cluster_indices);
-
-    std::vector<PointCloudRGBPtr> result;
-
-    int j = 0;
-    for (std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin();
-         it != cluster_indices.end(); ++it) {
-        PointCloudRGBPtr cloud_cluster(new PointCloudRGB);
-        for (std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); ++pit)
-            cloud_cluster->points.push_back(input->points[*pit]);
-        cloud_cluster->width = cloud_cluster->points.size();
-        cloud_cluster->height = 1;
-        cloud_cluster->is_dense = true;
-        j++;
-
-        result.push_back(cloud_cluster);
-    }
-    return result[0];
+/**
+ * Task of the worker pool: processes one file and prints the progress.
+ */
+void processFileTask(const std::string &file, const PerceptionCoreParams &params, bool force,
+                     BatchProgress *progress) {
+    FileResult result = processFile(file, params, force);
+    const char *result_names[] = {"processed", "up to date", "failed"};
+
+    boost::mutex::scoped_lock lock(progress->mutex);
+    progress->done++;
+    progress->results[result]++;
+    double seconds = progress->watch.getTimeSeconds();
+    double files_per_second = seconds > 0.0 ? progress->done / seconds : 0.0;
+    double remaining = files_per_second > 0.0 ? (progress->total - progress->done) / files_per_second : 0.0;
+    printf("[%lu/%lu] %s: %s (%.2f files/s, %.0f s left)\n", progress->done, progress->total,
+           file.c_str(), result_names[result], files_per_second, remaining);
+    fflush(stdout);
 }
 
-
-void batchPCD2histograms(std::string input) {
+/**
+ * Computes the features of all PCD files in a list on a worker pool.
+ * @param input file with one path per line
+ * @param color_config binning of the color histogram
+ * @param mls_normals CVFH uses the MLS normals, like the vision node with ~cvfh_mls_normals
+ * @param normal_radius radius of the normals CVFH estimates, like ~normal_radius of the vision node
+ * @param threads 0 uses one per core
+ * @param force compute all features, even the ones that are up to date
+ */
+void batchPCD2histograms(std::string input, const ColorHistogramConfig &color_config, bool mls_normals,
+                         float normal_radius, unsigned int threads, bool force) {
+    const PerceptionCoreParams params = trainingParams(color_config, mls_normals, normal_radius);
     std::ifstream is(input.c_str());
     std::string line;
-    std::string line_trimmed;
-
+    std::vector<std::string> files;
     while (getline(is, line)) {
-        pcl::PointCloud<pcl::PointXYZRGB>::Ptr input_cloud(new pcl::PointCloud<pcl::PointXYZRGB>), input_sampler (new pcl::PointCloud<pcl::PointXYZRGB>);
-        std::vector<float> input_cvfhs_features;
-        std::vector<uint64_t> input_color_features;
-
-        // load file
-        std::cout << "load file " << line << std::endl;
-        if (pcl::io::loadPCDFile<pcl::PointXYZRGB>(line, *input_sampler) != 0){
-            //downsample partial view
-            std::cout << "input before filtering size is: " << input_sampler->size() << std::endl;
-
-            pcl::VoxelGrid<pcl::PointXYZRGB> sor;
-            sor.setInputCloud(input_sampler);
-            sor.setLeafSize(0.0025f, 0.0025f, 0.0025f); //from 0.005 (perception) zu
-            sor.filter(*input_cloud);
-
-            //prepare files
-            line.erase(line.size() - 4, 4);
-            std::string normals = line + "_normals_histogram.csv";
-            std::string colors = line + "_colors_histogram.csv";
-            std::ofstream os_normals(normals.c_str());
-            std::ofstream os_colors(colors.c_str());
-            //std::string normals_list = line + "_normals_only.csv";
-            //std::ofstream os_normals_list(normals_list.c_str());
-
-            // save empty .csv
-
-            os_normals.close();
-            os_colors.close();
-            //os_normals_list;
-
-        } else {
-            //downsample partial view
-            std::cout << "input before filtering size is: " << input_sampler->size() << std::endl;
-
-            pcl::VoxelGrid<pcl::PointXYZRGB> sor;
-            sor.setInputCloud(input_sampler);
-            sor.setLeafSize(0.0025f, 0.0025f, 0.0025f); //from 0.005 (perception) zu
-            sor.filter(*input_cloud);
-            // prepare files
-            std::cout << "cloud size is: " << input_cloud->size() << std::endl;
-            line.erase(line.size() - 4, 4);
-            std::string normals = line + "_normals_histogram.csv";
-            std::string colors = line + "_colors_histogram.csv";
-            std::ofstream os_normals(normals.c_str());
-            std::ofstream os_colors(colors.c_str());
-            //std::string normals_list = line + "_curvature.csv";
-            //std::ofstream os_normals_list(normals_list.c_str());
-
-
-            input_cloud = mlsFilter(input_cloud);
-            input_cloud = euclideanClusterExtraction(input_cloud);
-
-            // estimate features
-
-            std::cout << "estimating cvfh features..." << std::endl;
-            input_cvfhs_features = cvfhRecognition(input_cloud);
-
-            input_color_features = produceColorHist(input_cloud);
-            std::cout << "creating color histogram..." << std::endl;
-
-                // save features to .csv
-                std::cout << "feature and color histogram size ok. saving file" << std::endl;
-
-                for (int i = 0; i < input_cvfhs_features.size(); i++) {
-                    if (i == input_cvfhs_features.size() - 1) {
-                        os_normals << input_cvfhs_features[i];
-                    } else {
-                        os_normals << input_cvfhs_features[i] << ", ";
-
-
-                    }
-                }
+        if (line.size() > 4) {
+            files.push_back(line);
+        }
+    }
 
+    WorkerPool pool(threads);
+    BatchProgress progress;
+    progress.total = files.size();
+    std::cout << files.size() << " files, " << pool.size() << " threads, " << parameterVersion(params) << std::endl;
 
-            for (int j = 0; j < input_color_features.size(); j++) {
-                if (j == input_color_features.size()-1){
-                    os_colors << input_color_features[j];
+    std::vector<WorkerPool::Task> tasks;
+    for (size_t i = 0; i < files.size(); i++) {
+        tasks.push_back(boost::bind(&processFileTask, boost::cref(files[i]), boost::cref(params), force, &progress));
+    }
+    pool.run(tasks);
 
-                } else {
-                    os_colors << input_color_features[j] << ", ";
+    double seconds = progress.watch.getTimeSeconds();
+    printf("%lu processed, %lu up to date, %lu failed in %.1f s (%.2f files/s)\n",
+           progress.results[FILE_PROCESSED], progress.results[FILE_SKIPPED], progress.results[FILE_FAILED], seconds,
+           seconds > 0.0 ? files.size() / seconds : 0.0);
+}
 
+int main(int argc, char** argv){
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <pcd list> [color bins] [rgb|hsv] [--threads=N] [--force] [--mls-normals]"
+                  << " [--normal-radius=M]" << std::endl;
+        return 1;
+    }
 
-                }
+    // The defaults are what the vision node uses
+    ColorHistogramConfig color_config;
+    unsigned int threads = 0; // one per core
+    bool force = false;
+    bool mls_normals = false;
+    float normal_radius = PerceptionCoreParams().normal_radius;
+    std::vector<std::string> positional;
+    for (int i = 2; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument.compare(0, 10, "--threads=") == 0) {
+            threads = std::max(atoi(argument.c_str() + 10), 0);
+        } else if (argument == "--force") {
+            force = true;
+        } else if (argument == "--mls-normals") {
+            mls_normals = true;
+        } else if (argument.compare(0, 16, "--normal-radius=") == 0) {
+            normal_radius = atof(argument.c_str() + 16);
+            if (normal_radius <= 0.0f) {
+                std::cerr << "the normal radius must be a positive number of meters" << std::endl;
+                return 1;
             }
-                /**
-                // curvature of normals
-                int curvatures[4] = {0,0,0,0};
-                 for (int k = 0; k < cloud_normals->size(); k++) {
-                     pcl::Normal p = cloud_normals->points[k];
-                     if (p.curvature == 0) {
-                         curvatures[0]++;
-                     } else if (p.curvature > 0 && p.curvature < 0.05) {
-                         curvatures[2]++;
-                     } else if (p.curvature > 0.05 && p.curvature <= 0.001) {
-                         curvatures[3]++;
-                     } else {
-                         curvatures[1]++;
-                     }
-                 }
-
-                for (int l = 0; l < 4; l++) {
-
-
-                    if (l == 3){
-                        os_normals_list << curvatures[l];
-
-                    } else {
-                        os_normals_list << curvatures[l] << ", ";
-
-
-                    }
-                }
-                 }
-                 **/
-                // os_normals_list.close();
-                os_normals.close();
-                os_colors.close();
-
+        } else {
+            positional.push_back(argument);
         }
-
     }
-}
+    if (positional.size() > 0) {
+        color_config.bins = atoi(positional[0].c_str());
+        if (color_config.bins < 1 || color_config.bins > 256) {
+            std::cerr << "color bins must be a number between 1 and 256, the object name isn't an argument anymore"
+                      << std::endl;
+            return 1;
+        }
+    }
+    if (positional.size() > 1 && positional[1] == "hsv") {
+        color_config.color_space = COLOR_SPACE_HSV;
+    }
 
-int main(int argc, char** argv){
-    batchPCD2histograms(argv[1]);
+    // The progress is printed per file, the log of the filters would drown it
+    pcl::console::setVerbosityLevel(pcl::console::L_WARN);
+
+    batchPCD2histograms(argv[1], color_config, mls_normals, normal_radius, threads, force);
     return 0;
 }
 